@@ -1,5 +1,6 @@
 
 import Foundation
+import Appstax_Private
 
 // TODO: Make internal
 @objc public class AXApiClient: NSObject {
@@ -8,110 +9,222 @@ import Foundation
     var baseUrl: String
     var appKey: String
     var urlSession: NSURLSession
+    var fileSession: NSURLSession
+    
+    /// Request bodies for postDictionary and putDictionary of at least this many bytes
+    /// are sent gzip compressed with Content-Encoding: gzip. 0 disables compression.
+    public var requestCompressionThreshold = 0
+    
+    /// Max number of retries for a request that failed with a transient network error,
+    /// 429 or 502-504. 500 is left out since it usually means an error that will repeat.
+    /// GET, PUT and DELETE are retried, and POST only when retryPosts is enabled.
+    public var maxRetries = 3
+    
+    /// Sends POST requests with an x-appstax-idempotency-key header and retries them.
+    /// Only enable this for servers that use the key to discard duplicate writes.
+    public var retryPosts = false
+    
+    /// Retries wait a random time up to retryBaseDelay * 2^(retry - 1), capped at maxRetryDelay
+    public var retryBaseDelay: NSTimeInterval = 0.2
+    public var maxRetryDelay: NSTimeInterval = 5
+    
+    /// Retries spend from a shared budget that successful requests slowly refill,
+    /// so retries stop when most requests are failing
+    public var retryBudget: Double = 10
+    
+    /// Called on the main queue when a request has completed, after any retries
+    public var metricsHandler: ((AXRequestMetrics) -> ())?
+    
+    /// Max number of GET responses kept for revalidation with ETag/Last-Modified
+    public var maxValidatedResponses = 50
+    
+    /// Responses larger than this are not kept for revalidation
+    public var maxValidatedResponseLength = 1024 * 1024
+    
+    /// Number of GET requests answered with 304 Not Modified and served from memory
+    public var validatedResponseHits: Int {
+        get {
+            var hits = 0
+            dispatch_sync(stateQueue) { hits = self.hits }
+            return hits
+        }
+    }
+    
+    /// Number of GET requests that downloaded a full response body
+    public var validatedResponseMisses: Int {
+        get {
+            var misses = 0
+            dispatch_sync(stateQueue) { misses = self.misses }
+            return misses
+        }
+    }
+    
+    /// Number of GET requests that joined an identical request already in flight
+    public var coalescedRequests: Int {
+        get {
+            var coalesced = 0
+            dispatch_sync(stateQueue) { coalesced = self.coalesced }
+            return coalesced
+        }
+    }
+    
+    // responses are decoded and stored on the url session's queue, so the
+    // validator store and in-flight requests are only touched on stateQueue
+    private let stateQueue = dispatch_queue_create("com.appstax.apiclient.state", DISPATCH_QUEUE_SERIAL)
+    private var validatedResponses: [String:AXValidatedResponse] = [:]
+    private var validatedResponseKeys: [String] = []
+    private var inFlightGets: [String:[AXGetWaiter]] = [:]
+    private var hits = 0
+    private var misses = 0
+    private var coalesced = 0
+    private var retryTokens: Double = -1
     
     public func updateSessionID(id: String?) {
         sessionID = id
     }
     
-    public init(appKey: String, baseUrl: String) {
+    public convenience init(appKey: String, baseUrl: String) {
+        self.init(appKey: appKey, baseUrl: baseUrl, configuration: AXApiClient.defaultSessionConfiguration())
+    }
+    
+    /// API requests use a session with the given configuration. File uploads and downloads
+    /// use a separate session with the same settings, so large transfers don't hold up API calls.
+    /// File transfers are only limited by the request timeout, which applies while they make no progress.
+    public init(appKey: String, baseUrl: String, configuration: NSURLSessionConfiguration) {
         self.appKey = appKey
         self.baseUrl = baseUrl
         self.sessionID = nil
-        self.urlSession = NSURLSession.sharedSession()
+        self.urlSession = NSURLSession(configuration: configuration)
+        let fileConfiguration = configuration.copy() as! NSURLSessionConfiguration
+        fileConfiguration.URLCache = nil
+        fileConfiguration.timeoutIntervalForRequest = max(configuration.timeoutIntervalForRequest, 120)
+        fileConfiguration.timeoutIntervalForResource = 7 * 24 * 60 * 60
+        self.fileSession = NSURLSession(configuration: fileConfiguration)
+    }
+    
+    /// Connection and cache settings used by default. HTTP/2 is negotiated automatically over TLS.
+    public static func defaultSessionConfiguration() -> NSURLSessionConfiguration {
+        let configuration = NSURLSessionConfiguration.defaultSessionConfiguration()
+        configuration.HTTPMaximumConnectionsPerHost = 4
+        configuration.HTTPShouldUsePipelining = true
+        configuration.timeoutIntervalForRequest = 30
+        configuration.timeoutIntervalForResource = 300
+        configuration.URLCache = NSURLCache(memoryCapacity: 2 * 1024 * 1024, diskCapacity: 10 * 1024 * 1024, diskPath: "AppstaxApiCache")
+        configuration.requestCachePolicy = .UseProtocolCachePolicy
+        return configuration
+    }
+    
+    deinit {
+        urlSession.finishTasksAndInvalidate()
+        fileSession.finishTasksAndInvalidate()
     }
     
     public func postDictionary(dictionary: [String:AnyObject], toUrl: NSURL, completion: (([String:AnyObject]?, NSError?) -> ())?) {
-        sendHttpBody(serializeDictionary(dictionary), toUrl: toUrl, method: "POST", headers: [:]) {
+        sendJSONBody(serializeDictionary(dictionary), toUrl: toUrl, method: "POST") {
             completion?(self.deserializeDictionary($0), $1)
         }
     }
     
     public func putDictionary(dictionary: [String:AnyObject], toUrl: NSURL, completion: (([String:AnyObject]?, NSError?) -> ())?) {
-        sendHttpBody(serializeDictionary(dictionary), toUrl: toUrl, method: "PUT", headers: [:]) {
+        sendJSONBody(serializeDictionary(dictionary), toUrl: toUrl, method: "PUT") {
             completion?(self.deserializeDictionary($0), $1)
         }
     }
     
     public func sendMultipartFormData(dataPartsSource: [String:AnyObject], toUrl: NSURL, method: String, completion: (([String:AnyObject]?, NSError?) -> ())?) {
         var dataParts = dataPartsSource
-        let boundary = "Boundary-\(NSUUID().UUIDString)"
-        let contentType = "multipart/form-data; boundary=\(boundary)"
-        let body = NSMutableData()
+        let body = AXMultipartBody()
         
         // put object data first
         let objectDataKey = "sysObjectData"
         if let objectData = dataParts[objectDataKey] {
-            appendMultipartData(body: body, boundary: boundary, partName: objectDataKey, part: objectData)
+            body.appendPart(objectDataKey, part: objectData)
             dataParts.removeValueForKey(objectDataKey)
         }
         
         for (partName, part) in dataParts {
-            appendMultipartData(body: body, boundary:boundary, partName: partName, part: part)
+            body.appendPart(partName, part: part)
         }
-        body.appendData(stringData("--\(boundary)--\r\n"))
+        AXLog.trace("Created multipart request body with part headers: \(body.headersDescription)")
         
-        if let bodyString = NSString(data: body, encoding: NSUTF8StringEncoding) {
-            AXLog.trace("Created multipart request body: \(bodyString)")
-        } else if let bodyString = NSString(data: body, encoding: NSASCIIStringEncoding) {
-            AXLog.trace("Created multipart request body (ASCII): \(bodyString)")
-        } else {
-            AXLog.trace("Created multipart request body. Unable to show string representation.")
+        let headers = ["Content-Type": body.contentType]
+        if !body.isStreamed {
+            sendHttpBody(body.data(), toUrl: toUrl, method: method, headers: headers, session: fileSession) {
+                completion?(self.deserializeDictionary($0), $1)
+            }
+            return
         }
         
-        sendHttpBody(body, toUrl: toUrl, method: method, headers: ["Content-Type":contentType]) {
-            completion?(self.deserializeDictionary($0), $1)
+        // parts backed by files on disk are spooled to a temporary file in chunks
+        // off the main thread and uploaded from there, so the file is never loaded into memory
+        body.writeToTemporaryFile() {
+            bodyFile, error in
+            guard let bodyFile = bodyFile else {
+                AXLog.error("Unable to create multipart request body: \(error?.localizedDescription ?? "")")
+                completion?(nil, error)
+                return
+            }
+            self.sendHttpBodyFromFile(bodyFile, toUrl: toUrl, method: method, headers: headers) {
+                _ = try? NSFileManager.defaultManager().removeItemAtURL(bodyFile)
+                completion?(self.deserializeDictionary($0), $1)
+            }
         }
     }
     
-    private func appendMultipartData(body body: NSMutableData, boundary: String, partName: String, part: AnyObject) {
-        let filename = part["filename"] as! String? ?? ""
-        let mimeType = part["mimeType"] as! String? ?? ""
-        let data = part["data"] as! NSData
-        body.appendData(stringData("--\(boundary)\r\n"))
-        if filename != "" {
-            body.appendData(stringData("Content-Disposition: form-data; name=\"\(partName)\"; filename=\"\(filename)\"\r\n"))
-        } else {
-            body.appendData(stringData("Content-Disposition: form-data; name=\"\(partName)\"\r\n"))
+    public func putData(data: NSData, toUrl: NSURL, headers: [String:String], completion: ((NSData?, NSError?) -> ())?) {
+        sendHttpBody(data, toUrl: toUrl, method: "PUT", headers: headers, session: fileSession) {
+            completion?($0, $1)
         }
-        if mimeType != "" {
-            body.appendData(stringData("Content-Type: \(mimeType)\r\n"))
-        }
-        body.appendData(stringData("\r\n"))
-        body.appendData(data)
-        body.appendData(stringData("\r\n"))
     }
     
     public func dictionaryFromUrl(url: NSURL, completion: (([String:AnyObject]?, NSError?) -> ())?) {
-        dataFromUrl(url) {
-            completion?(self.deserializeDictionary($0), $1)
+        dictionaryFromUrl(url, queue: dispatch_get_main_queue(), completion: completion)
+    }
+    
+    /// Fetches and decodes a dictionary off the main thread, and calls completion on the given queue.
+    /// Responses are not kept for revalidation unless validate is true.
+    public func dictionaryFromUrl(url: NSURL, queue: dispatch_queue_t, validate: Bool = true, completion: (([String:AnyObject]?, NSError?) -> ())?) {
+        getFromUrl(url, queue: queue, validate: validate, decodeJSON: true, session: urlSession) {
+            completion?($1 as? [String:AnyObject], $2)
         }
     }
     
     public func arrayFromUrl(url: NSURL, completion: (([AnyObject]?, NSError?) -> ())?) {
-        dataFromUrl(url) {
-            completion?(self.deserializeArray($0), $1)
+        getFromUrl(url, queue: dispatch_get_main_queue(), validate: true, decodeJSON: true, session: urlSession) {
+            completion?($1 as? [AnyObject], $2)
         }
     }
     
     public func dataFromUrl(url: NSURL, completion: ((NSData?, NSError?) -> ())?) {
+        getFromUrl(url, queue: dispatch_get_main_queue(), validate: true, decodeJSON: false, session: urlSession) {
+            completion?($0, $2)
+        }
+    }
+    
+    /// Downloads file contents using the file session, without keeping them for revalidation
+    public func fileDataFromUrl(url: NSURL, completion: ((NSData?, NSError?) -> ())?) {
+        getFromUrl(url, queue: dispatch_get_main_queue(), validate: false, decodeJSON: false, session: fileSession) {
+            completion?($0, $2)
+        }
+    }
+    
+    /// Downloads data using the file session, without coalescing or revalidation.
+    /// The returned handle cancels the download, including pending retries.
+    public func downloadDataFromUrl(url: NSURL, completion: (NSData?, NSError?) -> ()) -> AXRequestHandle {
+        let handle = AXRequestHandle()
         let request = makeRequestWithMethod("GET", url: url, headers: [:])
         logRequest(request)
-        urlSession.dataTaskWithRequest(request) {
-            var data = $0
-            let response = $1
-            var error = $2
-            
-            self.logResponse(response, data: data, error: error)
-            if error == nil {
-                error = self.errorFromResponse(response, data: data)
-            }
-            if error != nil {
-                data = nil
-            }
-            dispatch_async(dispatch_get_main_queue()) {
-                completion?(data, error);
-            }
-        }.resume()
+        resumeTask(request, handle: handle, completion: taskCompletionHandler(completion)) {
+            self.fileSession.dataTaskWithRequest(request, completionHandler: $0)
+        }
+        return handle
+    }
+    
+    public func removeValidatedResponses() {
+        dispatch_sync(stateQueue) {
+            self.validatedResponses = [:]
+            self.validatedResponseKeys = []
+        }
     }
     
     public func deleteUrl(url: NSURL, completion: ((NSError?) -> ())? = nil) {
@@ -151,6 +264,10 @@ import Foundation
         return NSURL(string: url.stringByAppendingString(queryString))
     }
     
+    private func deserializeJSON(data: NSData) -> AnyObject? {
+        return try? NSJSONSerialization.JSONObjectWithData(data, options: NSJSONReadingOptions(rawValue: 0))
+    }
+    
     public func deserializeDictionary(data: NSData?) -> [String:AnyObject]? {
         if data == nil {
             return nil
@@ -188,27 +305,259 @@ import Foundation
     
     // PRIVATE
     
-    private func sendHttpBody(httpBody: NSData, toUrl url: NSURL, method: String, headers: [String:String], completion: (NSData?, NSError?) -> ()) {
+    private func sendJSONBody(httpBody: NSData, toUrl url: NSURL, method: String, completion: (NSData?, NSError?) -> ()) {
+        if requestCompressionThreshold > 0 && httpBody.length >= requestCompressionThreshold,
+            let compressed = AXCompression.gzipData(httpBody) {
+            AXLog.trace("Compressed request body from \(httpBody.length) to \(compressed.length) bytes")
+            sendHttpBody(compressed, toUrl: url, method: method, headers: ["Content-Encoding": "gzip"], completion: completion)
+        } else {
+            sendHttpBody(httpBody, toUrl: url, method: method, headers: [:], completion: completion)
+        }
+    }
+    
+    private func sendHttpBody(httpBody: NSData, toUrl url: NSURL, method: String, headers: [String:String], session: NSURLSession? = nil, completion: (NSData?, NSError?) -> ()) {
         let request = makeRequestWithMethod(method, url: url, headers: headers)
+        setIdempotencyKey(request)
         request.HTTPBody = httpBody
         NSURLProtocol.setProperty(request.HTTPBody!, forKey: "HTTPBody", inRequest: request)
         logRequest(request)
-        urlSession.uploadTaskWithRequest(request, fromData: nil) {
-            var data = $0
-            let response = $1
-            var error = $2
+        resumeTask(request, completion: taskCompletionHandler(completion)) {
+            (session ?? self.urlSession).uploadTaskWithRequest(request, fromData: nil, completionHandler: $0)
+        }
+    }
+    
+    private func sendHttpBodyFromFile(fileUrl: NSURL, toUrl url: NSURL, method: String, headers: [String:String], completion: (NSData?, NSError?) -> ()) {
+        let request = makeRequestWithMethod(method, url: url, headers: headers)
+        setIdempotencyKey(request)
+        if let path = fileUrl.path {
+            NSURLProtocol.setProperty(path, forKey: "HTTPBodyFile", inRequest: request)
+        }
+        logRequest(request)
+        resumeTask(request, completion: taskCompletionHandler(completion)) {
+            self.fileSession.uploadTaskWithRequest(request, fromFile: fileUrl, completionHandler: $0)
+        }
+    }
+    
+    // Identical GET requests for the same url, user session, url session and validate flag share
+    // one request while it is in flight, and the response is decoded once and fanned out to all
+    // waiters on their own queues. GET requests send the validators from the last response for
+    // the same key, and a 304 Not Modified is answered with the stored body and decoded object.
+    // Decoding happens on the url session's queue before completion is dispatched to queue.
+    private func getFromUrl(url: NSURL, queue: dispatch_queue_t, validate: Bool, decodeJSON: Bool, session: NSURLSession, completion: (NSData?, AnyObject?, NSError?) -> ()) {
+        let sessionName = session === fileSession ? "file" : "api"
+        let key = "\(sessionID ?? "")|\(sessionName)|\(validate)|\(url.absoluteString)"
+        let waiter = AXGetWaiter(queue: queue, decodeJSON: decodeJSON, completion: completion)
+        var cached: AXValidatedResponse?
+        var joined = false
+        dispatch_sync(stateQueue) {
+            if let waiters = self.inFlightGets[key] {
+                self.inFlightGets[key] = waiters + [waiter]
+                self.coalesced += 1
+                joined = true
+            } else {
+                self.inFlightGets[key] = [waiter]
+                cached = validate ? self.validatedResponses[key] : nil
+            }
+        }
+        if joined {
+            AXLog.debug("HTTP Request: GET : \(url) joined request in flight")
+            return
+        }
+        
+        var headers: [String:String] = [:]
+        if let etag = cached?.etag {
+            headers["If-None-Match"] = etag
+        }
+        if let lastModified = cached?.lastModified {
+            headers["If-Modified-Since"] = lastModified
+        }
+        let request = makeRequestWithMethod("GET", url: url, headers: headers)
+        if cached != nil {
+            // let a 304 through instead of having the url cache answer it
+            request.cachePolicy = .ReloadIgnoringLocalCacheData
+        }
+        logRequest(request)
+        
+        resumeTask(request, completion: {
+            data, response, error in
+            let httpResponse = response as? NSHTTPURLResponse
+            var waiters: [AXGetWaiter] = []
+            dispatch_sync(self.stateQueue) {
+                waiters = self.inFlightGets.removeValueForKey(key) ?? []
+            }
+            let needsJSON = waiters.contains({ $0.decodeJSON })
+            
+            var resultData: NSData?
+            var resultError: NSError?
+            var decoded: AnyObject?
+            if let cached = cached where error == nil && httpResponse?.statusCode == 304 {
+                AXLog.debug("HTTP Response: 304 \(url), using stored response")
+                dispatch_sync(self.stateQueue) {
+                    self.hits += 1
+                    decoded = cached.decoded
+                }
+                if decoded == nil && needsJSON {
+                    decoded = self.deserializeJSON(cached.data)
+                    dispatch_sync(self.stateQueue) { cached.decoded = decoded }
+                }
+                resultData = cached.data
+            } else {
+                (resultData, resultError) = self.checkResponse(data, response: response, error: error)
+                if let data = resultData {
+                    decoded = needsJSON ? self.deserializeJSON(data) : nil
+                    if validate {
+                        self.storeValidatedResponse(key, response: httpResponse, data: data, decoded: decoded)
+                    }
+                }
+            }
             
-            self.logResponse(response, data: data, error: error)
-            if error == nil {
-                error = self.errorFromResponse(response, data: data)
+            for waiter in waiters {
+                dispatch_async(waiter.queue) {
+                    waiter.completion(resultData, waiter.decodeJSON ? decoded : nil, resultError)
+                }
+            }
+        }) {
+            session.dataTaskWithRequest(request, completionHandler: $0)
+        }
+    }
+    
+    // Runs the task created by createTask, and creates a new one for each retry
+    private func resumeTask(request: NSURLRequest, attempt: Int = 1, startTime: NSDate = NSDate(), handle: AXRequestHandle? = nil, completion: (NSData?, NSURLResponse?, NSError?) -> (), createTask: ((NSData?, NSURLResponse?, NSError?) -> ()) -> NSURLSessionTask) {
+        let task = createTask({
+            data, response, error in
+            let statusCode = (response as? NSHTTPURLResponse)?.statusCode ?? 0
+            if self.shouldRetry(request, statusCode: statusCode, error: error, attempt: attempt) {
+                let delay = self.retryDelay(attempt)
+                AXLog.info("Retrying \(request.HTTPMethod ?? "") \(request.URL?.absoluteString ?? "") in \(delay)s (attempt \(attempt + 1))")
+                let time = dispatch_time(DISPATCH_TIME_NOW, Int64(delay * Double(NSEC_PER_SEC)))
+                dispatch_after(time, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)) {
+                    self.resumeTask(request, attempt: attempt + 1, startTime: startTime, handle: handle, completion: completion, createTask: createTask)
+                }
+                return
+            }
+            if statusCode / 100 == 2 || statusCode == 304 {
+                self.refillRetryBudget()
+            }
+            self.reportMetrics(request, attempts: attempt, startTime: startTime, statusCode: statusCode, error: error)
+            completion(data, response, error)
+        })
+        handle?.setTask(task)
+        task.resume()
+    }
+    
+    private func shouldRetry(request: NSURLRequest, statusCode: Int, error: NSError?, attempt: Int) -> Bool {
+        if attempt > maxRetries {
+            return false
+        }
+        let method = request.HTTPMethod ?? "GET"
+        if method == "POST" && request.valueForHTTPHeaderField("x-appstax-idempotency-key") == nil {
+            return false
+        }
+        var transient = [429, 502, 503, 504].contains(statusCode)
+        if let error = error where error.domain == NSURLErrorDomain {
+            transient = [NSURLErrorTimedOut, NSURLErrorCannotFindHost, NSURLErrorCannotConnectToHost,
+                         NSURLErrorNetworkConnectionLost, NSURLErrorDNSLookupFailed, NSURLErrorNotConnectedToInternet].contains(error.code)
+        }
+        if !transient {
+            return false
+        }
+        var allowed = false
+        dispatch_sync(stateQueue) {
+            if self.retryTokens < 0 {
+                self.retryTokens = self.retryBudget
+            }
+            if self.retryTokens >= 1 {
+                self.retryTokens -= 1
+                allowed = true
+            }
+        }
+        if !allowed {
+            AXLog.warn("Retry budget exhausted, not retrying \(method) \(request.URL?.absoluteString ?? "")")
+        }
+        return allowed
+    }
+    
+    private func retryDelay(attempt: Int) -> NSTimeInterval {
+        let maxDelay = min(maxRetryDelay, retryBaseDelay * pow(2, Double(attempt - 1)))
+        return maxDelay * Double(arc4random_uniform(1001)) / 1000
+    }
+    
+    private func refillRetryBudget() {
+        dispatch_sync(stateQueue) {
+            if self.retryTokens >= 0 {
+                self.retryTokens = min(self.retryBudget, self.retryTokens + 0.1)
+            }
+        }
+    }
+    
+    private func reportMetrics(request: NSURLRequest, attempts: Int, startTime: NSDate, statusCode: Int, error: NSError?) {
+        guard let handler = metricsHandler else {
+            return
+        }
+        let metrics = AXRequestMetrics(method: request.HTTPMethod ?? "GET",
+                                       url: request.URL,
+                                       attempts: attempts,
+                                       duration: NSDate().timeIntervalSinceDate(startTime),
+                                       statusCode: statusCode,
+                                       error: error)
+        dispatch_async(dispatch_get_main_queue()) {
+            handler(metrics)
+        }
+    }
+    
+    private func storeValidatedResponse(key: String, response: NSHTTPURLResponse?, data: NSData, decoded: AnyObject?) {
+        let etag = headerValue("ETag", response: response)
+        let lastModified = headerValue("Last-Modified", response: response)
+        let store = (etag != nil || lastModified != nil) && data.length <= maxValidatedResponseLength
+        let limit = max(maxValidatedResponses, 0)
+        dispatch_sync(stateQueue) {
+            self.misses += 1
+            if let index = self.validatedResponseKeys.indexOf(key) {
+                self.validatedResponseKeys.removeAtIndex(index)
+                self.validatedResponses.removeValueForKey(key)
             }
-            if error != nil {
-                data = nil
+            if !store {
+                return
+            }
+            let validated = AXValidatedResponse(etag: etag, lastModified: lastModified, data: data)
+            validated.decoded = decoded
+            self.validatedResponses[key] = validated
+            self.validatedResponseKeys.append(key)
+            while self.validatedResponseKeys.count > limit {
+                self.validatedResponses.removeValueForKey(self.validatedResponseKeys.removeFirst())
+            }
+        }
+    }
+    
+    private func headerValue(name: String, response: NSHTTPURLResponse?) -> String? {
+        for (key, value) in response?.allHeaderFields ?? [:] {
+            if let key = key as? String where key.caseInsensitiveCompare(name) == .OrderedSame {
+                return value as? String
             }
+        }
+        return nil
+    }
+    
+    private func taskCompletionHandler(completion: (NSData?, NSError?) -> ()) -> (NSData?, NSURLResponse?, NSError?) -> () {
+        return {
+            let (data, error) = self.checkResponse($0, response: $1, error: $2)
             dispatch_async(dispatch_get_main_queue()) {
                 completion(data, error);
             }
-        }.resume()
+        }
+    }
+    
+    private func checkResponse(data: NSData?, response: NSURLResponse?, error: NSError?) -> (NSData?, NSError?) {
+        logResponse(response, data: data, error: error)
+        let checkedError = error ?? errorFromResponse(response, data: data)
+        return (checkedError == nil ? data : nil, checkedError)
+    }
+    
+    // the same key is sent with every retry, so the server can tell a retried create from a new one
+    private func setIdempotencyKey(request: NSMutableURLRequest) {
+        if retryPosts && request.HTTPMethod == "POST" {
+            request.setValue(NSUUID().UUIDString, forHTTPHeaderField: "x-appstax-idempotency-key")
+        }
     }
     
     private func makeRequestWithMethod(method: String, url: NSURL, headers: [String:String]) -> NSMutableURLRequest {
@@ -228,7 +577,10 @@ import Foundation
         let method = request.HTTPMethod ?? "(no http method)"
         let url = request.URL?.absoluteString ?? "(no url)"
         AXLog.debug("HTTP Request: \(method) : \(url)")
-        if let body = NSString(data: request.HTTPBody ?? NSData(), encoding: NSUTF8StringEncoding) {
+        let contentType = request.valueForHTTPHeaderField("Content-Type") ?? ""
+        if contentType.hasPrefix("multipart/") || contentType == "application/octet-stream" || request.valueForHTTPHeaderField("Content-Encoding") != nil {
+            AXLog.trace("HTTP Request body is \(contentType). Not showing string representation.")
+        } else if let body = NSString(data: request.HTTPBody ?? NSData(), encoding: NSUTF8StringEncoding) {
             AXLog.trace("HTTP Request body: \(body)")
         } else {
             AXLog.trace("No HTTP Request body, or unable to decode it as UTF-8 string. Could be multipart.")
@@ -269,9 +621,76 @@ import Foundation
         }
         return error
     }
+
+}
+
+private class AXValidatedResponse {
+    
+    let etag: String?
+    let lastModified: String?
+    let data: NSData
+    var decoded: AnyObject?
+    
+    init(etag: String?, lastModified: String?, data: NSData) {
+        self.etag = etag
+        self.lastModified = lastModified
+        self.data = data
+    }
+}
+
+private struct AXGetWaiter {
+    let queue: dispatch_queue_t
+    let decodeJSON: Bool
+    let completion: (NSData?, AnyObject?, NSError?) -> ()
+}
+
+/// Cancels a request started by AXApiClient, including any pending retries
+@objc public class AXRequestHandle: NSObject {
+    
+    private var task: NSURLSessionTask?
+    private var cancelled = false
     
-    func stringData(string: String) -> NSData {
-        return string.dataUsingEncoding(NSUTF8StringEncoding, allowLossyConversion: false)!
+    public var isCancelled: Bool {
+        objc_sync_enter(self)
+        let cancelled = self.cancelled
+        objc_sync_exit(self)
+        return cancelled
     }
     
-}
\ No newline at end of file
+    public func cancel() {
+        objc_sync_enter(self)
+        cancelled = true
+        let task = self.task
+        objc_sync_exit(self)
+        task?.cancel()
+    }
+    
+    private func setTask(task: NSURLSessionTask) {
+        objc_sync_enter(self)
+        self.task = task
+        let cancelled = self.cancelled
+        objc_sync_exit(self)
+        if cancelled {
+            task.cancel()
+        }
+    }
+}
+
+@objc public class AXRequestMetrics: NSObject {
+    
+    public let method: String
+    public let url: NSURL?
+    public let attempts: Int
+    public let duration: NSTimeInterval
+    public let statusCode: Int
+    public let error: NSError?
+    
+    init(method: String, url: NSURL?, attempts: Int, duration: NSTimeInterval, statusCode: Int, error: NSError?) {
+        self.method = method
+        self.url = url
+        self.attempts = attempts
+        self.duration = duration
+        self.statusCode = statusCode
+        self.error = error
+    }
+}
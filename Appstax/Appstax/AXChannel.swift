@@ -35,20 +35,29 @@ import Foundation
         sendInitialCommands()
     }
     
+    deinit {
+        realtimeService?.removeChannel(name, id: ObjectIdentifier(self))
+        realtimeService?.unsubscribe(name, filter: filter)
+    }
+    
+    // Channels are only registered while they are referenced, so keep a reference
+    // to a channel for as long as its events are needed
     private func setupEvents() {
-        realtimeService.on("*", handler: self.eventHub.dispatch)
+        realtimeService.addChannel(self)
+    }
+    
+    internal func receive(event: AXEvent) {
+        eventHub.dispatch(event)
     }
     
     private func sendInitialCommands() {
-        realtimeService.send(command: "subscribe", channel: self.name, filter: filter)
+        realtimeService.subscribe(name, filter: filter)
     }
     
     public func on(event: String, handler: (AXChannelEvent) -> ()) {
         eventHub.on(event) {
             if let channelEvent = $0 as? AXChannelEvent {
-                if self.shouldReceiveEvent(channelEvent) {
-                    handler(channelEvent)
-                }
+                handler(channelEvent)
             } else {
                 handler(AXChannelEvent(["event": $0.type]))
             }
@@ -59,6 +68,12 @@ import Foundation
         realtimeService.send(command: "publish", channel: self.name, message: message)
     }
     
+    // With replaceQueued, a message sent while disconnected replaces the
+    // previous message still waiting to be sent on this channel
+    public func send(message: AnyObject, replaceQueued: Bool) {
+        realtimeService.send(command: "publish", channel: self.name, message: message, replaceQueued: replaceQueued)
+    }
+    
     public func grant(who: String, permissions:[String]) {
         sendCreate()
         for permission in permissions {
@@ -80,16 +95,6 @@ import Foundation
             createSendt = true
         }
     }
-    
-    private func shouldReceiveEvent(event: AXChannelEvent) -> Bool {
-        if name.hasSuffix("*") {
-            let length = name.characters.count - 1
-            let match = name.substringToIndex(name.startIndex.advancedBy(length))
-            return event.channel.hasPrefix(match)
-        } else {
-            return event.channel == self.name
-        }
-    }
 
 }
 
@@ -0,0 +1,8 @@
+#import <Foundation/Foundation.h>
+
+@interface AXCompression : NSObject
+
++ (NSData *)gzipData:(NSData *)data;
++ (NSData *)gunzipData:(NSData *)data;
+
+@end
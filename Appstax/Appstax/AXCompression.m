@@ -0,0 +1,50 @@
+
+#import "AXCompression.h"
+#import <zlib.h>
+
+static const NSUInteger AXCompressionChunkSize = 16384;
+
+@implementation AXCompression
+
++ (NSData *)gzipData:(NSData *)data {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // window bits 15 + 16 writes a gzip header and trailer
+    if(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nil;
+    }
+    NSMutableData *output = [NSMutableData dataWithLength:deflateBound(&stream, data.length)];
+    stream.next_in = (Bytef *)data.bytes;
+    stream.avail_in = (uInt)data.length;
+    stream.next_out = output.mutableBytes;
+    stream.avail_out = (uInt)output.length;
+    int status = deflate(&stream, Z_FINISH);
+    output.length = stream.total_out;
+    deflateEnd(&stream);
+    return status == Z_STREAM_END ? output : nil;
+}
+
++ (NSData *)gunzipData:(NSData *)data {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(inflateInit2(&stream, 15 + 16) != Z_OK) {
+        return nil;
+    }
+    NSMutableData *output = [NSMutableData dataWithLength:data.length * 2 + AXCompressionChunkSize];
+    stream.next_in = (Bytef *)data.bytes;
+    stream.avail_in = (uInt)data.length;
+    int status = Z_OK;
+    while(status == Z_OK) {
+        if(stream.total_out >= output.length) {
+            output.length += AXCompressionChunkSize;
+        }
+        stream.next_out = (Bytef *)output.mutableBytes + stream.total_out;
+        stream.avail_out = (uInt)(output.length - stream.total_out);
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+    output.length = stream.total_out;
+    inflateEnd(&stream);
+    return status == Z_STREAM_END ? output : nil;
+}
+
+@end
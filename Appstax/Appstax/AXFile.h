@@ -8,6 +8,12 @@ typedef enum {
     AXFileStatusSaved
 } AXFileStatus;
 
+typedef enum {
+    AXDownloadPriorityVisible,
+    AXDownloadPriorityPrefetch,
+    AXDownloadPriorityBackground
+} AXDownloadPriority;
+
 @interface AXFile : NSObject
 
 // TODO: Make internal when converting to Swift
@@ -19,13 +25,22 @@ typedef enum {
 @property (readonly) NSString *dataPath;
 @property (readonly) NSString *mimeType;
 
+// Upload progress while saving. Observable with KVO.
+@property (readonly) unsigned long long bytesUploaded;
+@property (readonly) unsigned long long totalBytes;
+@property (readonly) float uploadProgress;
+
 + (instancetype)fileWithData:(NSData *)data name:(NSString *)name;
 + (instancetype)fileWithImage:(UIImage *)image name:(NSString *)name;
 + (instancetype)fileWithPath:(NSString *)path;
 + (instancetype)fileWithUrl:(NSURL *)url name:(NSString *)name status:(AXFileStatus)status;
 
-- (void)load:(void(^)(NSError *error))completion;
-- (void)loadImageSize:(CGSize)size crop:(BOOL)crop completion:(void(^)(NSError *error))completion;
+// Loads return a token for cancelLoad:. A cancelled load never completes.
+- (id)load:(void(^)(NSError *error))completion;
+- (id)loadWithPriority:(AXDownloadPriority)priority completion:(void(^)(NSError *error))completion;
+- (id)loadImageSize:(CGSize)size crop:(BOOL)crop completion:(void(^)(NSError *error))completion;
+- (id)loadImageSize:(CGSize)size crop:(BOOL)crop priority:(AXDownloadPriority)priority completion:(void(^)(NSError *error))completion;
+- (void)cancelLoad:(id)token;
 - (void)unload;
 
 @end
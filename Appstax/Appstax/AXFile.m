@@ -3,8 +3,15 @@
 #import "AppstaxInternals.h"
 #import <Appstax/Appstax-Swift.h>
 
+@interface AXFile ()
+@property AXFileDataCache *dataCache;
+@property NSString *dataCacheKey;
+@end
+
 @implementation AXFile
 
+@synthesize data = _data;
+
 + (instancetype)fileWithData:(NSData *)data name:(NSString *)name {
     return [[AXFile alloc] initWithData:data dataPath:nil name:name url:nil status:AXFileStatusNew];
 }
@@ -35,14 +42,71 @@
     return self;
 }
 
+- (void)dealloc {
+    [_dataCache removeKey:_dataCacheKey];
+}
+
+// Loaded data may have been moved to disk by the data cache
+- (NSData *)data {
+    if(_dataCacheKey != nil) {
+        if(_data == nil) {
+            _data = [_dataCache reloadDataForKey:_dataCacheKey];
+        } else {
+            [_dataCache touchKey:_dataCacheKey];
+        }
+    }
+    return _data;
+}
+
 - (void)setData:(NSData *)data {
+    [_dataCache removeKey:_dataCacheKey];
+    _dataCacheKey = nil;
     _data = data;
 }
 
-- (void)load:(void(^)(NSError *error))completion {
-    [[[Appstax defaultContext] fileService] loadDataForFile:self completion:^(AXFile *file, NSData *data, NSError *error) {
+- (void)setLoadedData:(NSData *)data {
+    AXFileDataCache *dataCache = [[[Appstax defaultContext] fileService] dataCache];
+    if(dataCache != _dataCache) {
+        [_dataCache removeKey:_dataCacheKey];
+        _dataCacheKey = nil;
+        _dataCache = dataCache;
+    }
+    _data = data;
+    _dataCacheKey = [_dataCache addData:data forFile:self key:_dataCacheKey];
+}
+
+- (NSData *)evictData {
+    NSData *data = _data;
+    _data = nil;
+    return data;
+}
+
+- (void)setBytesUploaded:(unsigned long long)bytesUploaded totalBytes:(unsigned long long)totalBytes {
+    [self willChangeValueForKey:@"bytesUploaded"];
+    [self willChangeValueForKey:@"totalBytes"];
+    [self willChangeValueForKey:@"uploadProgress"];
+    _bytesUploaded = bytesUploaded;
+    _totalBytes = totalBytes;
+    [self didChangeValueForKey:@"uploadProgress"];
+    [self didChangeValueForKey:@"totalBytes"];
+    [self didChangeValueForKey:@"bytesUploaded"];
+}
+
+- (float)uploadProgress {
+    if(_totalBytes == 0) {
+        return _status == AXFileStatusSaved ? 1 : 0;
+    }
+    return (float)((double)_bytesUploaded / (double)_totalBytes);
+}
+
+- (id)load:(void(^)(NSError *error))completion {
+    return [self loadWithPriority:AXDownloadPriorityVisible completion:completion];
+}
+
+- (id)loadWithPriority:(AXDownloadPriority)priority completion:(void(^)(NSError *error))completion {
+    return [[[Appstax defaultContext] fileService] loadDataForFile:self priority:priority completion:^(AXFile *file, NSData *data, NSError *error) {
         if(!error) {
-            _data = data;
+            [self setLoadedData:data];
         }
         if(completion) {
             completion(error);
@@ -50,10 +114,14 @@
     }];
 }
 
-- (void)loadImageSize:(CGSize)size crop:(BOOL)crop completion:(void(^)(NSError *error))completion {
-    [[[Appstax defaultContext] fileService] loadImageDataForFile:self size:size crop:crop completion:^(AXFile *file, NSData *data, NSError *error) {
+- (id)loadImageSize:(CGSize)size crop:(BOOL)crop completion:(void(^)(NSError *error))completion {
+    return [self loadImageSize:size crop:crop priority:AXDownloadPriorityVisible completion:completion];
+}
+
+- (id)loadImageSize:(CGSize)size crop:(BOOL)crop priority:(AXDownloadPriority)priority completion:(void(^)(NSError *error))completion {
+    return [[[Appstax defaultContext] fileService] loadImageDataForFile:self size:size crop:crop priority:priority completion:^(AXFile *file, NSData *data, NSError *error) {
         if(!error) {
-            _data = data;
+            [self setLoadedData:data];
         }
         if(completion) {
             completion(error);
@@ -61,8 +129,12 @@
     }];
 }
 
+- (void)cancelLoad:(id)token {
+    [[[Appstax defaultContext] fileService] cancelDownload:token];
+}
+
 - (void)unload {
-    _data = nil;
+    [self setData:nil];
 }
 
 + (NSString *)mimeTypeFromFilename:(NSString *)filename {
@@ -0,0 +1,25 @@
+
+#import <Foundation/Foundation.h>
+
+// Keeps track of the data loaded into AXFile objects with load: and
+// loadImageSize:crop:completion:. When more than memoryBudget bytes are loaded,
+// the least recently used data is moved to disk, and it is read back the next
+// time the file data is accessed. All loaded data is moved to disk on memory
+// warnings. Data in new files that are not saved yet is never moved.
+//
+// Each cache spills to a subdirectory of its own in directory, which is
+// removed when the cache is released. Files hold on to the cache their data
+// was added to. Subdirectories left by earlier launches are removed when the
+// first cache is created.
+@interface AXFileDataCache : NSObject
+
+@property unsigned long long memoryBudget;
+@property (readonly) unsigned long long residentBytes;
+@property (readonly) unsigned long long spilledBytes;
+@property (readonly) NSUInteger evictionCount;
+
+- (instancetype)initWithDirectory:(NSString *)directory;
+
+- (void)evictAllData;
+
+@end
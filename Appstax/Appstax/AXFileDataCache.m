@@ -0,0 +1,172 @@
+
+#import "AXFileDataCache.h"
+#import "AppstaxInternals.h"
+#import <UIKit/UIKit.h>
+
+@interface AXFileDataCache ()
+@property NSString *directory;
+@property NSMapTable *files;
+@property NSMutableDictionary *sizes;
+@property NSMutableOrderedSet *order;
+@property NSMutableDictionary *spilledSizes;
+@property dispatch_queue_t ioQueue;
+@end
+
+@implementation AXFileDataCache
+
+// Shared by all caches, so directories from earlier launches are removed before
+// any cache creates its own
++ (dispatch_queue_t)ioQueue {
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.appstax.filedatacache.io", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+- (instancetype)initWithDirectory:(NSString *)directory {
+    self = [super init];
+    if(self != nil) {
+        _directory = [directory stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+        _memoryBudget = 32 * 1024 * 1024;
+        _files = [NSMapTable strongToWeakObjectsMapTable];
+        _sizes = [NSMutableDictionary dictionary];
+        _order = [NSMutableOrderedSet orderedSet];
+        _spilledSizes = [NSMutableDictionary dictionary];
+        _ioQueue = [AXFileDataCache ioQueue];
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+            dispatch_async(_ioQueue, ^{
+                [[NSFileManager defaultManager] removeItemAtPath:directory error:nil];
+            });
+        });
+        NSString *ownDirectory = _directory;
+        dispatch_async(_ioQueue, ^{
+            [[NSFileManager defaultManager] createDirectoryAtPath:ownDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+        });
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(evictAllData)
+                                                     name:UIApplicationDidReceiveMemoryWarningNotification
+                                                   object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    NSString *directory = _directory;
+    dispatch_async(_ioQueue, ^{
+        [[NSFileManager defaultManager] removeItemAtPath:directory error:nil];
+    });
+}
+
+- (void)evictAllData {
+    @synchronized(self) {
+        while(_order.count > 0) {
+            [self evictKey:_order.firstObject];
+        }
+    }
+}
+
+#pragma mark - Internal
+
+- (NSString *)addData:(NSData *)data forFile:(AXFile *)file key:(NSString *)key {
+    key = key ?: [NSUUID UUID].UUIDString;
+    @synchronized(self) {
+        [self removeKey:key];
+        [_files setObject:file forKey:key];
+        [self addResidentKey:key size:data.length];
+        [self evictToBudget];
+    }
+    return key;
+}
+
+- (void)touchKey:(NSString *)key {
+    @synchronized(self) {
+        if([_order containsObject:key]) {
+            [_order removeObject:key];
+            [_order addObject:key];
+        }
+    }
+}
+
+- (NSData *)reloadDataForKey:(NSString *)key {
+    NSString *path = [self pathForKey:key];
+    __block NSData *data;
+    dispatch_sync(_ioQueue, ^{
+        data = [NSData dataWithContentsOfFile:path];
+    });
+    if(data != nil) {
+        @synchronized(self) {
+            if(_sizes[key] == nil) {
+                [self addResidentKey:key size:data.length];
+            }
+            [self evictToBudget];
+        }
+    }
+    return data;
+}
+
+- (void)removeKey:(NSString *)key {
+    if(key == nil) {
+        return;
+    }
+    @synchronized(self) {
+        NSNumber *size = _sizes[key];
+        if(size != nil) {
+            _residentBytes -= size.unsignedLongLongValue;
+            [_sizes removeObjectForKey:key];
+            [_order removeObject:key];
+        }
+        NSNumber *spilledSize = _spilledSizes[key];
+        if(spilledSize != nil) {
+            _spilledBytes -= spilledSize.unsignedLongLongValue;
+            [_spilledSizes removeObjectForKey:key];
+            NSString *path = [self pathForKey:key];
+            dispatch_async(_ioQueue, ^{
+                [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+            });
+        }
+        [_files removeObjectForKey:key];
+    }
+}
+
+#pragma mark - Eviction
+
+- (void)addResidentKey:(NSString *)key size:(NSUInteger)size {
+    _sizes[key] = @(size);
+    [_order addObject:key];
+    _residentBytes += size;
+}
+
+// The most recently used data stays in memory even when it is larger than the budget
+- (void)evictToBudget {
+    while(_residentBytes > _memoryBudget && _order.count > 1) {
+        [self evictKey:_order.firstObject];
+    }
+}
+
+// Spilled data is immutable, so data that has been written once is only dropped from memory
+- (void)evictKey:(NSString *)key {
+    _residentBytes -= [_sizes[key] unsignedLongLongValue];
+    [_sizes removeObjectForKey:key];
+    [_order removeObject:key];
+    _evictionCount++;
+    NSData *data = [[_files objectForKey:key] evictData];
+    if(data == nil || _spilledSizes[key] != nil) {
+        return;
+    }
+    _spilledSizes[key] = @(data.length);
+    _spilledBytes += data.length;
+    NSString *path = [self pathForKey:key];
+    dispatch_async(_ioQueue, ^{
+        [data writeToFile:path atomically:YES];
+    });
+}
+
+- (NSString *)pathForKey:(NSString *)key {
+    return [_directory stringByAppendingPathComponent:key];
+}
+
+@end
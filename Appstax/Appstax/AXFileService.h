@@ -3,16 +3,48 @@
 #import "AXFile.h"
 
 @class AXApiClient;
+@class AXFileDataCache;
+@class AXImageCache;
 @class AXObject;
 
 @interface AXFileService : NSObject
 
+// Files larger than chunkedUploadThreshold are uploaded in ranges of
+// uploadChunkSize bytes, at most maxConcurrentChunkUploads at a time.
+// Acknowledged ranges are remembered, so saving the same file again
+// after an interruption only sends the missing ranges. Chunked uploads
+// need server support for Content-Range uploads, so they are off until
+// a threshold is set.
+@property unsigned long long chunkedUploadThreshold;
+@property NSUInteger uploadChunkSize;
+@property NSUInteger maxConcurrentChunkUploads;
+
+// Images shown by AXImageView
+@property AXImageCache *imageCache;
+
+// Data loaded into files
+@property AXFileDataCache *dataCache;
+
+// Downloads run at most maxConcurrentDownloads at a time. Queued visible
+// downloads start newest first, then prefetch and background downloads
+// in the order they were requested. Downloads of the same url are shared,
+// and run at the highest priority they were requested with. The returned
+// tokens cancel downloads with cancelDownload:. Loads without a priority
+// are visible.
+@property NSUInteger maxConcurrentDownloads;
+
 - (instancetype)initWithApiClient:(AXApiClient *)apiClient;
 
 - (void)saveFilesForObject:(AXObject *)object completion:(void(^)(NSError *error))completion;
-- (void)loadDataForFile:(AXFile *)file completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion;
-- (void)loadImageDataForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion;
+- (id)loadDataForFile:(AXFile *)file completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion;
+- (id)loadDataForFile:(AXFile *)file priority:(AXDownloadPriority)priority completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion;
+- (id)loadImageDataForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion;
+- (id)loadImageDataForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop priority:(AXDownloadPriority)priority completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion;
+- (id)downloadDataFromUrl:(NSURL *)url priority:(AXDownloadPriority)priority completion:(void(^)(NSData *data, NSError *error))completion;
+- (void)setPriority:(AXDownloadPriority)priority forDownload:(id)token;
+- (void)cancelDownload:(id)token;
 - (NSURL *)urlForFileName:(NSString *)filename objectID:(NSString *)objectID propertyName:(NSString *)propertyName collectionName:(NSString *)collectionName;
 - (NSData *)dataForFile:(AXFile *)file;
+- (NSDictionary *)multipartForFile:(AXFile *)file;
 
 @end
@@ -1,10 +1,183 @@
 
 #import "AppstaxInternals.h"
 #import "AXFileService.h"
+#import "AXImageCache.h"
+#import "AXFileDataCache.h"
 #import <Appstax/Appstax-Swift.h>
+#import <CommonCrypto/CommonDigest.h>
+
+static NSString * const AXChunkedUploadsDefaultsKey = @"AppstaxChunkedUploads";
+
+@interface AXChunkedUpload : NSObject
+@property AXApiClient *apiClient;
+@property AXFile *file;
+@property NSURL *url;
+@property unsigned long long size;
+@property NSUInteger chunkSize;
+@property NSUInteger window;
+@property NSString *stateKey;
+@property NSString *uploadID;
+@property NSMutableIndexSet *pending;
+@property NSMutableIndexSet *acknowledged;
+@property NSUInteger inFlight;
+@property unsigned long long bytesUploaded;
+@property NSError *error;
+@property (copy) void(^completion)(NSError *error);
+@end
+
+@implementation AXChunkedUpload
+
+- (instancetype)initWithFile:(AXFile *)file url:(NSURL *)url size:(unsigned long long)size chunkSize:(NSUInteger)chunkSize window:(NSUInteger)window apiClient:(AXApiClient *)apiClient {
+    self = [super init];
+    if(self != nil) {
+        _apiClient = apiClient;
+        _file = file;
+        _url = url;
+        _size = size;
+        _chunkSize = MAX(chunkSize, 1);
+        _window = MAX(window, 1);
+        _stateKey = [NSString stringWithFormat:@"%@|%llu|%lu|%@|%@", url.absoluteString, size, (unsigned long)_chunkSize, file.dataPath ?: @"", [self contentVersion]];
+        _pending = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, (NSUInteger)((size + _chunkSize - 1) / _chunkSize))];
+        _acknowledged = [NSMutableIndexSet indexSet];
+        [self restoreState];
+    }
+    return self;
+}
+
+// Acknowledged ranges are only reused for the same content, so files changed
+// in place are identified by modification date and data in memory by digest
+- (NSString *)contentVersion {
+    if(_file.data != nil) {
+        unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+        CC_SHA1(_file.data.bytes, (CC_LONG)_file.data.length, digest);
+        NSMutableString *hex = [NSMutableString string];
+        for(int i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
+            [hex appendFormat:@"%02x", digest[i]];
+        }
+        return hex;
+    }
+    if(_file.dataPath == nil) {
+        return @"";
+    }
+    NSDate *modified = [[NSFileManager defaultManager] attributesOfItemAtPath:_file.dataPath error:nil].fileModificationDate;
+    return [NSString stringWithFormat:@"%f", modified.timeIntervalSince1970];
+}
+
+- (void)start:(void(^)(NSError *error))completion {
+    _completion = completion;
+    [_file setBytesUploaded:_bytesUploaded totalBytes:_size];
+    [self sendNextChunks];
+}
+
+- (void)sendNextChunks {
+    while(_error == nil && _inFlight < _window && _pending.count > 0) {
+        NSUInteger index = _pending.firstIndex;
+        [_pending removeIndex:index];
+        [self sendChunk:index];
+    }
+    if(_inFlight == 0 && (_pending.count == 0 || _error != nil)) {
+        [self finish];
+    }
+}
+
+- (void)sendChunk:(NSUInteger)index {
+    unsigned long long offset = (unsigned long long)index * _chunkSize;
+    NSUInteger length = (NSUInteger)MIN((unsigned long long)_chunkSize, _size - offset);
+    NSData *data = [self readRangeWithOffset:offset length:length];
+    if(data == nil) {
+        _error = [NSError errorWithDomain:@"AXFileError" code:0 userInfo:@{NSLocalizedDescriptionKey:@"Unable to read file for upload"}];
+        return;
+    }
+    NSDictionary *headers = @{@"Content-Type":@"application/octet-stream",
+                              @"Content-Range":[NSString stringWithFormat:@"bytes %llu-%llu/%llu", offset, offset + length - 1, _size],
+                              @"x-appstax-upload-id":_uploadID};
+    _inFlight++;
+    [_apiClient putData:data toUrl:_url headers:headers completion:^(NSData *response, NSError *error) {
+        _inFlight--;
+        if(error == nil) {
+            [_acknowledged addIndex:index];
+            _bytesUploaded += length;
+            [_file setBytesUploaded:_bytesUploaded totalBytes:_size];
+            [self saveState];
+        } else if(_error == nil) {
+            _error = error;
+        }
+        [self sendNextChunks];
+    }];
+}
+
+- (NSData *)readRangeWithOffset:(unsigned long long)offset length:(NSUInteger)length {
+    if(_file.data != nil) {
+        return [_file.data subdataWithRange:NSMakeRange((NSUInteger)offset, length)];
+    }
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:_file.dataPath];
+    if(handle == nil) {
+        return nil;
+    }
+    [handle seekToFileOffset:offset];
+    NSData *data = [handle readDataOfLength:length];
+    [handle closeFile];
+    return data.length == length ? data : nil;
+}
+
+- (void)finish {
+    if(_error == nil) {
+        [self clearState];
+    }
+    void(^completion)(NSError *) = _completion;
+    _completion = nil;
+    if(completion) {
+        completion(_error);
+    }
+}
+
+- (void)restoreState {
+    NSDictionary *state = [[NSUserDefaults standardUserDefaults] dictionaryForKey:AXChunkedUploadsDefaultsKey][_stateKey];
+    _uploadID = state[@"uploadId"] ?: [[NSUUID UUID] UUIDString];
+    for(NSNumber *index in state[@"acknowledged"]) {
+        if([_pending containsIndex:index.unsignedIntegerValue]) {
+            [_pending removeIndex:index.unsignedIntegerValue];
+            [_acknowledged addIndex:index.unsignedIntegerValue];
+            _bytesUploaded += MIN((unsigned long long)_chunkSize, _size - (unsigned long long)index.unsignedIntegerValue * _chunkSize);
+        }
+    }
+}
+
+- (void)saveState {
+    NSMutableArray *acknowledged = [NSMutableArray arrayWithCapacity:_acknowledged.count];
+    [_acknowledged enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        [acknowledged addObject:@(index)];
+    }];
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSMutableDictionary *uploads = [NSMutableDictionary dictionaryWithDictionary:[defaults dictionaryForKey:AXChunkedUploadsDefaultsKey] ?: @{}];
+    uploads[_stateKey] = @{@"uploadId":_uploadID, @"acknowledged":acknowledged};
+    [defaults setObject:uploads forKey:AXChunkedUploadsDefaultsKey];
+}
+
+- (void)clearState {
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSMutableDictionary *uploads = [NSMutableDictionary dictionaryWithDictionary:[defaults dictionaryForKey:AXChunkedUploadsDefaultsKey] ?: @{}];
+    [uploads removeObjectForKey:_stateKey];
+    [defaults setObject:uploads forKey:AXChunkedUploadsDefaultsKey];
+}
+
+@end
+
+@interface AXDownload : NSObject
+@property NSURL *url;
+@property AXDownloadPriority priority;
+@property NSMutableDictionary *completions;
+@property AXRequestHandle *handle;
+@end
+
+@implementation AXDownload
+@end
 
 @interface AXFileService()
 @property AXApiClient *apiClient;
+@property NSMutableDictionary *downloads;
+@property NSArray *queuedDownloads;
+@property NSUInteger activeDownloads;
 @end
 
 @implementation AXFileService
@@ -13,6 +186,16 @@
     self = [super init];
     if(self != nil) {
         _apiClient = apiClient;
+        _chunkedUploadThreshold = 0;
+        _uploadChunkSize = 1024 * 1024;
+        _maxConcurrentChunkUploads = 3;
+        _maxConcurrentDownloads = 4;
+        _downloads = [NSMutableDictionary dictionary];
+        _queuedDownloads = @[[NSMutableArray array], [NSMutableArray array], [NSMutableArray array]];
+        NSString *caches = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject ?: NSTemporaryDirectory();
+        _imageCache = [[AXImageCache alloc] initWithFileService:self
+                                                      directory:[caches stringByAppendingPathComponent:@"Appstax/Images"]];
+        _dataCache = [[AXFileDataCache alloc] initWithDirectory:[caches stringByAppendingPathComponent:@"Appstax/FileData"]];
     }
     return self;
 }
@@ -50,12 +233,28 @@
                      propertyName:propertyName collectionName:collectionName];
     [file setUrl:url];
     [file setStatus:AXFileStatusSaving];
-    [_apiClient sendMultipartFormData:@{@"file":@{@"data":[self dataForFile:file],
-                                                  @"mimeType":file.mimeType,
-                                                  @"filename":file.filename}}
+    unsigned long long size = [self sizeOfFile:file];
+    if(_chunkedUploadThreshold > 0 && size > _chunkedUploadThreshold) {
+        AXChunkedUpload *upload = [[AXChunkedUpload alloc] initWithFile:file url:url size:size
+                                                              chunkSize:_uploadChunkSize
+                                                                 window:_maxConcurrentChunkUploads
+                                                              apiClient:_apiClient];
+        [upload start:^(NSError *error) {
+            [file setStatus:error == nil ? AXFileStatusSaved : AXFileStatusNew];
+            if(completion) {
+                completion(error);
+            }
+        }];
+        return;
+    }
+    [file setBytesUploaded:0 totalBytes:size];
+    [_apiClient sendMultipartFormData:@{@"file":[self multipartForFile:file]}
                                 toUrl:url
                                method:@"PUT"
                            completion:^(NSDictionary *dictionary, NSError *error) {
+                               if(error == nil) {
+                                   [file setBytesUploaded:size totalBytes:size];
+                               }
                                if(completion) {
                                    [file setStatus:AXFileStatusSaved];
                                    completion(error);
@@ -63,23 +262,122 @@
                            }];
 }
 
-- (void)loadDataForFile:(AXFile *)file completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion {
-    [_apiClient dataFromUrl:file.url completion:^(NSData *data, NSError *error) {
+- (unsigned long long)sizeOfFile:(AXFile *)file {
+    if(file.data != nil) {
+        return file.data.length;
+    }
+    if(file.dataPath != nil) {
+        return [[[NSFileManager defaultManager] attributesOfItemAtPath:file.dataPath error:nil] fileSize];
+    }
+    return 0;
+}
+
+- (id)loadDataForFile:(AXFile *)file completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion {
+    return [self loadDataForFile:file priority:AXDownloadPriorityVisible completion:completion];
+}
+
+- (id)loadDataForFile:(AXFile *)file priority:(AXDownloadPriority)priority completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion {
+    return [self downloadDataFromUrl:file.url priority:priority completion:^(NSData *data, NSError *error) {
         if(completion) {
             completion(file, data, error);
         }
     }];
 }
 
-- (void)loadImageDataForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion {
+- (id)loadImageDataForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion {
+    return [self loadImageDataForFile:file size:size crop:crop priority:AXDownloadPriorityVisible completion:completion];
+}
+
+- (id)loadImageDataForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop priority:(AXDownloadPriority)priority completion:(void(^)(AXFile *file, NSData *data, NSError *error))completion {
     NSURL *url = [self imageUrlForFile:file size:size crop:crop];
-    [_apiClient dataFromUrl:url completion:^(NSData *data, NSError *error) {
+    return [self downloadDataFromUrl:url priority:priority completion:^(NSData *data, NSError *error) {
         if(completion) {
             completion(file, data, error);
         }
     }];
 }
 
+#pragma mark - Download scheduling
+
+- (id)downloadDataFromUrl:(NSURL *)url priority:(AXDownloadPriority)priority completion:(void(^)(NSData *data, NSError *error))completion {
+    NSString *key = url.absoluteString ?: @"";
+    NSUUID *token = [NSUUID UUID];
+    AXDownload *download = _downloads[key];
+    if(download == nil) {
+        download = [[AXDownload alloc] init];
+        download.url = url;
+        download.priority = priority;
+        download.completions = [NSMutableDictionary dictionary];
+        _downloads[key] = download;
+        [_queuedDownloads[priority] addObject:download];
+    } else if(priority < download.priority) {
+        [self setPriority:priority forQueuedDownload:download];
+    }
+    download.completions[token] = completion ?: ^(NSData *data, NSError *error) {};
+    [self startQueuedDownloads];
+    return @[key, token];
+}
+
+- (void)setPriority:(AXDownloadPriority)priority forDownload:(id)token {
+    if([token isKindOfClass:[NSArray class]]) {
+        [self setPriority:priority forQueuedDownload:_downloads[token[0]]];
+    }
+}
+
+- (void)setPriority:(AXDownloadPriority)priority forQueuedDownload:(AXDownload *)download {
+    if(download == nil) {
+        return;
+    }
+    if(download.handle == nil) {
+        [_queuedDownloads[download.priority] removeObjectIdenticalTo:download];
+        [_queuedDownloads[priority] addObject:download];
+    }
+    download.priority = priority;
+}
+
+- (void)cancelDownload:(id)token {
+    if(![token isKindOfClass:[NSArray class]]) {
+        return;
+    }
+    NSString *key = token[0];
+    AXDownload *download = _downloads[key];
+    [download.completions removeObjectForKey:token[1]];
+    if(download != nil && download.completions.count == 0) {
+        [_downloads removeObjectForKey:key];
+        if(download.handle != nil) {
+            [download.handle cancel];
+        } else {
+            [_queuedDownloads[download.priority] removeObjectIdenticalTo:download];
+        }
+    }
+}
+
+- (void)startQueuedDownloads {
+    while(_activeDownloads < MAX(_maxConcurrentDownloads, 1)) {
+        AXDownload *download = [_queuedDownloads[AXDownloadPriorityVisible] lastObject];
+        if(download == nil) {
+            download = [_queuedDownloads[AXDownloadPriorityPrefetch] firstObject] ?: [_queuedDownloads[AXDownloadPriorityBackground] firstObject];
+        }
+        if(download == nil) {
+            return;
+        }
+        [_queuedDownloads[download.priority] removeObjectIdenticalTo:download];
+        _activeDownloads++;
+        download.handle = [_apiClient downloadDataFromUrl:download.url completion:^(NSData *data, NSError *error) {
+            _activeDownloads--;
+            NSString *key = download.url.absoluteString ?: @"";
+            if(_downloads[key] == download) {
+                [_downloads removeObjectForKey:key];
+            }
+            for(void(^completion)(NSData *, NSError *) in download.completions.allValues) {
+                completion(data, error);
+            }
+            [download.completions removeAllObjects];
+            [self startQueuedDownloads];
+        }];
+    }
+}
+
 - (NSData *)dataForFile:(AXFile *)file {
     NSData *data = file.data;
     if(data == nil && file.dataPath != nil) {
@@ -91,6 +389,17 @@
     return data;
 }
 
+- (NSDictionary *)multipartForFile:(AXFile *)file {
+    if(file.data == nil && file.dataPath != nil) {
+        return @{@"path":file.dataPath,
+                 @"mimeType":file.mimeType,
+                 @"filename":file.filename};
+    }
+    return @{@"data":[self dataForFile:file],
+             @"mimeType":file.mimeType,
+             @"filename":file.filename};
+}
+
 - (NSURL *)urlForFileName:(NSString *)filename objectID:(NSString *)objectID propertyName:(NSString *)propertyName collectionName:(NSString *)collectionName {
     return [_apiClient urlFromTemplate:@"/files/:collectionName/:objectID/:propertyName/:fileName"
                             parameters:@{@"collectionName":collectionName,
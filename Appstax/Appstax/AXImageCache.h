@@ -0,0 +1,29 @@
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+#import "AXFileService.h"
+
+// Cache of images loaded by AXImageView, keyed by image url.
+// Decoded images are kept in memory up to memoryCapacity bytes of pixel data,
+// and downloaded image data is kept on disk up to diskCapacity bytes, both
+// evicting the least recently used images first. Loads of the same url share
+// one download, which is cancelled when all of its loads have been cancelled.
+// Downloads are scheduled by the file service at the highest priority of their
+// loads, and loads without a priority are visible.
+// Images are decoded on a background queue. Completion handlers are called on
+// the main queue, right away for images in memory.
+@interface AXImageCache : NSObject
+
+@property NSUInteger memoryCapacity;
+@property unsigned long long diskCapacity;
+@property (readonly) NSUInteger memoryUsage;
+
+- (instancetype)initWithFileService:(AXFileService *)fileService directory:(NSString *)directory;
+
+- (UIImage *)cachedImageForUrl:(NSURL *)url;
+- (id)loadImageFromUrl:(NSURL *)url completion:(void(^)(UIImage *image, NSError *error))completion;
+- (id)loadImageFromUrl:(NSURL *)url priority:(AXDownloadPriority)priority completion:(void(^)(UIImage *image, NSError *error))completion;
+- (void)cancelLoad:(id)token;
+- (void)removeAllImages;
+
+@end
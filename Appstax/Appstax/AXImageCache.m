@@ -0,0 +1,299 @@
+
+#import "AXImageCache.h"
+#import <Appstax/Appstax-Swift.h>
+#import <CommonCrypto/CommonDigest.h>
+
+@interface AXImageLoad : NSObject
+@property id downloadToken;
+@property AXDownloadPriority priority;
+@property NSMutableDictionary *completions;
+@end
+
+@implementation AXImageLoad
+@end
+
+@interface AXImageCache ()
+@property (weak) AXFileService *fileService;
+@property NSString *directory;
+@property NSMutableDictionary *images;
+@property NSMutableDictionary *imageCosts;
+@property NSMutableOrderedSet *imageOrder;
+@property NSMutableDictionary *loads;
+@property dispatch_queue_t ioQueue;
+@property dispatch_queue_t decodeQueue;
+@property long long diskUsage;
+@end
+
+@implementation AXImageCache
+
+- (instancetype)initWithFileService:(AXFileService *)fileService directory:(NSString *)directory {
+    self = [super init];
+    if(self != nil) {
+        _fileService = fileService;
+        _directory = directory;
+        _memoryCapacity = 20 * 1024 * 1024;
+        _diskCapacity = 50 * 1024 * 1024;
+        _images = [NSMutableDictionary dictionary];
+        _imageCosts = [NSMutableDictionary dictionary];
+        _imageOrder = [NSMutableOrderedSet orderedSet];
+        _loads = [NSMutableDictionary dictionary];
+        _ioQueue = dispatch_queue_create("com.appstax.imagecache.io", DISPATCH_QUEUE_SERIAL);
+        _decodeQueue = dispatch_queue_create("com.appstax.imagecache.decode", DISPATCH_QUEUE_CONCURRENT);
+        _diskUsage = -1;
+        [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(removeImagesFromMemory)
+                                                     name:UIApplicationDidReceiveMemoryWarningNotification
+                                                   object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (UIImage *)cachedImageForUrl:(NSURL *)url {
+    NSString *key = url.absoluteString;
+    UIImage *image = _images[key];
+    if(image != nil) {
+        [_imageOrder removeObject:key];
+        [_imageOrder addObject:key];
+    }
+    return image;
+}
+
+- (id)loadImageFromUrl:(NSURL *)url completion:(void(^)(UIImage *image, NSError *error))completion {
+    return [self loadImageFromUrl:url priority:AXDownloadPriorityVisible completion:completion];
+}
+
+- (id)loadImageFromUrl:(NSURL *)url priority:(AXDownloadPriority)priority completion:(void(^)(UIImage *image, NSError *error))completion {
+    UIImage *image = [self cachedImageForUrl:url];
+    if(image != nil) {
+        if(completion) {
+            completion(image, nil);
+        }
+        return nil;
+    }
+    
+    NSString *key = url.absoluteString;
+    NSUUID *token = [NSUUID UUID];
+    AXImageLoad *load = _loads[key];
+    if(load == nil) {
+        load = [[AXImageLoad alloc] init];
+        load.priority = priority;
+        load.completions = [NSMutableDictionary dictionary];
+        _loads[key] = load;
+        [self startLoad:load url:url];
+    } else if(priority < load.priority) {
+        load.priority = priority;
+        [_fileService setPriority:priority forDownload:load.downloadToken];
+    }
+    load.completions[token] = completion ?: ^(UIImage *image, NSError *error) {};
+    return @[key, token];
+}
+
+- (void)cancelLoad:(id)token {
+    if(![token isKindOfClass:[NSArray class]]) {
+        return;
+    }
+    NSString *key = token[0];
+    AXImageLoad *load = _loads[key];
+    [load.completions removeObjectForKey:token[1]];
+    if(load != nil && load.completions.count == 0) {
+        [_fileService cancelDownload:load.downloadToken];
+        [_loads removeObjectForKey:key];
+    }
+}
+
+- (void)removeAllImages {
+    [self removeImagesFromMemory];
+    NSString *directory = _directory;
+    dispatch_async(_ioQueue, ^{
+        [[NSFileManager defaultManager] removeItemAtPath:directory error:nil];
+        [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+        _diskUsage = 0;
+    });
+}
+
+- (void)removeImagesFromMemory {
+    [_images removeAllObjects];
+    [_imageCosts removeAllObjects];
+    [_imageOrder removeAllObjects];
+    _memoryUsage = 0;
+}
+
+#pragma mark - Loading
+
+- (void)startLoad:(AXImageLoad *)load url:(NSURL *)url {
+    NSString *path = [self pathForUrl:url];
+    dispatch_async(_ioQueue, ^{
+        NSData *data = [NSData dataWithContentsOfFile:path];
+        if(data != nil) {
+            [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate:[NSDate date]} ofItemAtPath:path error:nil];
+            [self decodeData:data url:url load:load store:NO];
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if(_loads[url.absoluteString] != load) {
+                return;
+            }
+            load.downloadToken = [_fileService downloadDataFromUrl:url priority:load.priority completion:^(NSData *data, NSError *error) {
+                if(error != nil || data == nil) {
+                    [self finishLoad:load url:url image:nil error:error];
+                } else {
+                    [self decodeData:data url:url load:load store:YES];
+                }
+            }];
+        });
+    });
+}
+
+- (void)decodeData:(NSData *)data url:(NSURL *)url load:(AXImageLoad *)load store:(BOOL)store {
+    dispatch_async(_decodeQueue, ^{
+        UIImage *image = [self decodedImageWithData:data];
+        if(image != nil && store) {
+            [self storeData:data path:[self pathForUrl:url]];
+        }
+        NSError *error = image != nil ? nil : [NSError errorWithDomain:@"AXImageError" code:0 userInfo:@{NSLocalizedDescriptionKey:@"Unable to decode image"}];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self finishLoad:load url:url image:image error:error];
+        });
+    });
+}
+
+- (void)finishLoad:(AXImageLoad *)load url:(NSURL *)url image:(UIImage *)image error:(NSError *)error {
+    NSString *key = url.absoluteString;
+    if(image != nil) {
+        [self storeImage:image key:key];
+    }
+    if(_loads[key] == load) {
+        [_loads removeObjectForKey:key];
+    }
+    for(void(^completion)(UIImage *, NSError *) in load.completions.allValues) {
+        completion(image, error);
+    }
+    [load.completions removeAllObjects];
+}
+
+// UIImage decodes lazily on first draw. Drawing it into a bitmap of its full
+// size here does the decoding off the main thread, and the returned image is
+// backed by that bitmap.
+- (UIImage *)decodedImageWithData:(NSData *)data {
+    UIImage *image = [UIImage imageWithData:data];
+    CGImageRef imageRef = image.CGImage;
+    if(imageRef == NULL) {
+        return image;
+    }
+    size_t width = CGImageGetWidth(imageRef);
+    size_t height = CGImageGetHeight(imageRef);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+    CGColorSpaceRelease(colorSpace);
+    if(context == NULL) {
+        return image;
+    }
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+    CGImageRef decodedRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    if(decodedRef == NULL) {
+        return image;
+    }
+    UIImage *decoded = [UIImage imageWithCGImage:decodedRef scale:image.scale orientation:image.imageOrientation];
+    CGImageRelease(decodedRef);
+    return decoded;
+}
+
+#pragma mark - Memory
+
+- (void)storeImage:(UIImage *)image key:(NSString *)key {
+    NSUInteger cost = CGImageGetBytesPerRow(image.CGImage) * CGImageGetHeight(image.CGImage);
+    if(cost > _memoryCapacity) {
+        return;
+    }
+    [self removeImageForKey:key];
+    _images[key] = image;
+    _imageCosts[key] = @(cost);
+    [_imageOrder addObject:key];
+    _memoryUsage += cost;
+    while(_memoryUsage > _memoryCapacity && _imageOrder.count > 0) {
+        [self removeImageForKey:_imageOrder.firstObject];
+    }
+}
+
+- (void)removeImageForKey:(NSString *)key {
+    NSNumber *cost = _imageCosts[key];
+    if(cost != nil) {
+        _memoryUsage -= cost.unsignedIntegerValue;
+        [_images removeObjectForKey:key];
+        [_imageCosts removeObjectForKey:key];
+        [_imageOrder removeObject:key];
+    }
+}
+
+#pragma mark - Disk
+
+- (NSString *)pathForUrl:(NSURL *)url {
+    NSData *keyData = [url.absoluteString dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1(keyData.bytes, (CC_LONG)keyData.length, digest);
+    NSMutableString *name = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+    for(int i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
+        [name appendFormat:@"%02x", digest[i]];
+    }
+    return [_directory stringByAppendingPathComponent:name];
+}
+
+- (void)storeData:(NSData *)data path:(NSString *)path {
+    dispatch_async(_ioQueue, ^{
+        if(![data writeToFile:path atomically:YES]) {
+            return;
+        }
+        if(_diskUsage < 0) {
+            _diskUsage = 0;
+            for(NSURL *fileUrl in [self diskFiles]) {
+                _diskUsage += [self sizeOfFileUrl:fileUrl];
+            }
+        } else {
+            _diskUsage += data.length;
+        }
+        if(_diskUsage > (long long)_diskCapacity) {
+            [self trimDisk];
+        }
+    });
+}
+
+// Removes the least recently used files until the cache is below 3/4 of its capacity
+- (void)trimDisk {
+    NSArray *files = [[self diskFiles] sortedArrayUsingComparator:^NSComparisonResult(NSURL *url1, NSURL *url2) {
+        NSDate *date1, *date2;
+        [url1 getResourceValue:&date1 forKey:NSURLContentModificationDateKey error:nil];
+        [url2 getResourceValue:&date2 forKey:NSURLContentModificationDateKey error:nil];
+        return [date1 compare:date2];
+    }];
+    long long target = (long long)(_diskCapacity * 3 / 4);
+    for(NSURL *fileUrl in files) {
+        if(_diskUsage <= target) {
+            break;
+        }
+        long long size = [self sizeOfFileUrl:fileUrl];
+        if([[NSFileManager defaultManager] removeItemAtURL:fileUrl error:nil]) {
+            _diskUsage -= size;
+        }
+    }
+}
+
+- (NSArray *)diskFiles {
+    return [[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:_directory]
+                                         includingPropertiesForKeys:@[NSURLContentModificationDateKey, NSURLFileSizeKey]
+                                                            options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                              error:nil] ?: @[];
+}
+
+- (long long)sizeOfFileUrl:(NSURL *)fileUrl {
+    NSNumber *size;
+    [fileUrl getResourceValue:&size forKey:NSURLFileSizeKey error:nil];
+    return size.longLongValue;
+}
+
+@end
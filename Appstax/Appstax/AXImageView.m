@@ -1,11 +1,13 @@
 
 
 #import "AXImageView.h"
+#import "AXImageCache.h"
 #import "AppstaxInternals.h"
 #import <Appstax/Appstax-Swift.h>
 
 @interface AXImageView()
 @property AXFile *file;
+@property id loadToken;
 @end
 
 @implementation AXImageView
@@ -23,19 +25,27 @@
 }
 
 - (void)loadFile:(AXFile *)file {
-    _file = file;
-    [[[Appstax defaultContext] fileService] loadDataForFile:file completion:^(AXFile *file, NSData *data, NSError *error) {
-        if(!error && file == _file) {
-            self.image = [UIImage imageWithData:data];
-        }
-    }];
+    [self loadFile:file url:file.url];
 }
 
 - (void)loadFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop {
+    AXFileService *fileService = [[Appstax defaultContext] fileService];
+    [self loadFile:file url:[fileService imageUrlForFile:file size:size crop:crop]];
+}
+
+// Cancels the load for the previous file, so reused views only download what they show
+- (void)loadFile:(AXFile *)file url:(NSURL *)url {
+    AXImageCache *imageCache = [[[Appstax defaultContext] fileService] imageCache];
+    [imageCache cancelLoad:_loadToken];
+    _loadToken = nil;
     _file = file;
-    [[[Appstax defaultContext] fileService] loadImageDataForFile:file size:size crop:crop completion:^(AXFile *file, NSData *data, NSError *error) {
+    if(url == nil) {
+        return;
+    }
+    _loadToken = [imageCache loadImageFromUrl:url completion:^(UIImage *image, NSError *error) {
         if(!error && file == _file) {
-            self.image = [UIImage imageWithData:data];
+            _loadToken = nil;
+            self.image = image;
         }
     }];
 }
@@ -6,10 +6,26 @@ import Foundation
     private let realtimeService: AXRealtimeService
     private var eventHub = AXEventHub()
     private var observers:[String:AXModelObserver] = [:]
-    private var allObjects:[String:AXObject] = [:]
+    private var store = AXModelStore()
+    private var channels: [AXChannel] = []
     private var connectedStatusCount = 0
+    private var disconnectedAt: NSDate?
+    private var changedNames: [String] = []
+    private var changeScheduled = false
     internal var channelFactory:((String, String) -> (AXChannel))?
     
+    // Changes are collected for this long, or until the next run loop turn,
+    // and then reported with one change event for each changed observer.
+    public var changeInterval: NSTimeInterval = 0
+    
+    // With deltaResync on, watched arrays load only the objects updated since the newest
+    // sysUpdated they have seen after reconnecting, unless the connection was down for
+    // more than maxResyncGap seconds. The server does not report deleted objects, so
+    // objects deleted while disconnected stay until the next full reload. It is off by
+    // default, and arrays with a filter or expand are always reloaded in full.
+    public var deltaResync = false
+    public var maxResyncGap: NSTimeInterval = 300
+    
     public override init() {
         realtimeService = Appstax.defaultContext.realtimeService
         super.init()
@@ -84,76 +100,203 @@ import Foundation
             if self.realtimeService.status == .Connected {
                 self.connectedStatusCount += 1
                 if self.connectedStatusCount > 1 {
-                    self.reload()
+                    self.resync()
                 }
+                self.disconnectedAt = nil
+            } else if self.disconnectedAt == nil {
+                self.disconnectedAt = NSDate()
             }
         }
     }
     
-    private func createChannel(name:String, filter:String) -> AXChannel {
-        if let factory = channelFactory {
-            return factory(name, filter)
+    private func resync() {
+        let gap = -(disconnectedAt?.timeIntervalSinceNow ?? 0)
+        if !deltaResync || gap > maxResyncGap {
+            reload()
+            return
+        }
+        observers.forEach() {
+            $1.resync()
         }
-        return AXChannel(name, filter: filter)
     }
     
-    private func notify(event: String) {
-        notify(AXModelEvent(type: event))
+    // Channels stop getting events when released, so the model keeps them
+    private func createChannel(name:String, filter:String) -> AXChannel {
+        let channel = channelFactory?(name, filter) ?? AXChannel(name, filter: filter)
+        channels.append(channel)
+        return channel
     }
     
     private func notify(event: AXModelEvent) {
         eventHub.dispatch(event)
     }
     
+    private func changed(name: String) {
+        if !changedNames.contains(name) {
+            changedNames.append(name)
+        }
+        if !changeScheduled {
+            changeScheduled = true
+            let time = dispatch_time(DISPATCH_TIME_NOW, Int64(changeInterval * Double(NSEC_PER_SEC)))
+            dispatch_after(time, dispatch_get_main_queue()) {
+                self.notifyChanges()
+            }
+        }
+    }
+    
+    private func notifyChanges() {
+        let names = changedNames
+        changedNames = []
+        changeScheduled = false
+        for name in names {
+            if let event = observers[name]?.takeChangeEvent() {
+                notify(event)
+            }
+        }
+    }
+    
+    // Only observers holding the object, or an object related to it, see the update
     private func update(object: AXObject, depth: Int = 0) {
-        normalize(object, depth: depth)
-        observers.forEach() {
-            $1.sort()
+        let normalized = normalize(object, depth: depth)
+        guard let id = normalized.objectID else {
+            return
+        }
+        let affected = store.objectIDsReferencing(id)
+        let changedKeys = store.changedKeys
+        for (_, observer) in observers {
+            observer.update(id, affected: affected, changedKeys: changedKeys)
         }
-        notify("change")
     }
     
     private func normalize(object: AXObject, depth: Int = 0) -> AXObject {
+        return store.normalize(object, depth: depth)
+    }
+
+}
+
+// Identity map of the objects in a model, with a reverse index of relations
+// from each object to the objects that have it as a related object. The
+// reverse index only grows, so it may list objects that have since dropped
+// the relation, which at worst causes an extra change event. The keys that
+// changed in existing objects during the last normalize are in changedKeys.
+private class AXModelStore {
+    
+    private var objects: [String:AXObject] = [:]
+    private var referrers: [String:Set<String>] = [:]
+    private(set) var changedKeys: [String:Set<String>] = [:]
+    
+    func normalize(object: AXObject, depth: Int = 0) -> AXObject {
+        changedKeys = [:]
+        return normalizeObject(object, depth: depth)
+    }
+    
+    private func normalizeObject(object: AXObject, depth: Int) -> AXObject {
         var normalized = object
+        var previous: [String:AnyObject]?
         if let id = object.objectID {
-            if allObjects[id] == nil {
-                normalized = object
-                allObjects[id] = normalized
-            } else {
-                normalized = allObjects[id]!
+            if let existing = objects[id] {
+                normalized = existing
+                previous = existing.allProperties
                 normalized.importValues(object)
+            } else {
+                objects[id] = object
             }
         }
         if depth >= 0 {
             object.allProperties.keys.forEach() { key in
                 if let property = object.object(key) {
-                    normalized[key] = self.normalize(property, depth: depth - 1)
+                    normalized[key] = self.normalizeRelated(property, referrer: normalized, depth: depth - 1)
                 } else if let property = object.objects(key) {
                     normalized[key] = property.map() {
-                        self.normalize($0, depth: depth - 1)
+                        self.normalizeRelated($0, referrer: normalized, depth: depth - 1)
                     }
                 }
             }
         }
+        if let previous = previous, let id = normalized.objectID {
+            var keys = changedKeys[id] ?? []
+            for key in object.allProperties.keys where !isEqual(previous[key], normalized[key]) {
+                keys.insert(key)
+            }
+            if !keys.isEmpty {
+                changedKeys[id] = keys
+            }
+        }
+        return normalized
+    }
+    
+    private func isEqual(value0: AnyObject?, _ value1: AnyObject?) -> Bool {
+        if let value0 = value0 as? NSObject, let value1 = value1 {
+            return value0.isEqual(value1)
+        }
+        return value0 == nil && value1 == nil
+    }
+    
+    private func normalizeRelated(object: AXObject, referrer: AXObject, depth: Int) -> AXObject {
+        let normalized = normalizeObject(object, depth: depth)
+        if let id = normalized.objectID, let referrerID = referrer.objectID {
+            var ids = referrers[id] ?? []
+            ids.insert(referrerID)
+            referrers[id] = ids
+        }
         return normalized
     }
     
+    // The given id and the ids of all objects referring to it, directly or through other objects
+    func objectIDsReferencing(id: String) -> Set<String> {
+        var result: Set<String> = [id]
+        var pending = [id]
+        while let next = pending.popLast() {
+            for referrerID in referrers[next] ?? [] where !result.contains(referrerID) {
+                result.insert(referrerID)
+                pending.append(referrerID)
+            }
+        }
+        return result
+    }
+
 }
 
+// Change events have the name of the changed observer. Events from watched arrays
+// also have the indexes that changed since the previous event, in the form table
+// views expect for animated updates: deleted and updated indexes are from before
+// the change, inserted indexes and the targets of moved indexes are from after it.
+// Moved objects are not listed as updated, even when their properties changed.
+// The objects are listed as well, with the keys that changed in each object by
+// objectID, including related objects. Consumers should reload the whole array
+// when reloaded is set.
 public class AXModelEvent: AXEvent {
     
     private(set) var error: String?
+    public private(set) var name: String?
+    public private(set) var reloaded = false
+    public internal(set) var insertedIndexes: [Int] = []
+    public internal(set) var deletedIndexes: [Int] = []
+    public internal(set) var updatedIndexes: [Int] = []
+    public internal(set) var movedIndexes: [Int:Int] = [:]
+    public internal(set) var insertedObjects: [AXObject] = []
+    public internal(set) var deletedObjects: [AXObject] = []
+    public internal(set) var updatedObjects: [AXObject] = []
+    public internal(set) var changedKeys: [String:[String]] = [:]
     
     init(type: String, error: String? = nil) {
         super.init(type: type)
         self.error = error
     }
+    
+    init(type: String, name: String, reloaded: Bool = false) {
+        super.init(type: type)
+        self.name = name
+        self.reloaded = reloaded
+    }
 }
 
 private protocol AXModelObserver {
     func load()
+    func resync()
     func connect()
-    func sort()
+    func update(objectID: String, affected: Set<String>, changedKeys: [String:Set<String>])
+    func takeChangeEvent() -> AXModelEvent?
     func get() -> AnyObject?
 }
 
@@ -183,11 +326,15 @@ private class AXModelCurrentUserObserver: AXModelObserver {
         if let currentUser = userService.currentUser {
             currentUser.refresh() { _ in
                 self.user = self.model.normalize(currentUser) as? AXUser
-                self.model.notify("change")
+                self.model.changed("currentUser")
             }
         }
     }
     
+    func resync() {
+        load()
+    }
+    
     func connect() {
         let channel = model.createChannel("objects/users", filter: "")
         channel.on("object.updated") {
@@ -201,10 +348,18 @@ private class AXModelCurrentUserObserver: AXModelObserver {
         } else {
             self.user = nil
         }
-        self.model.notify("change")
+        self.model.changed("currentUser")
+    }
+    
+    func update(objectID: String, affected: Set<String>, changedKeys: [String:Set<String>]) {
+        if let id = user?.objectID where affected.contains(id) {
+            model.changed("currentUser")
+        }
     }
     
-    func sort() {}
+    func takeChangeEvent() -> AXModelEvent? {
+        return AXModelEvent(type: "change", name: "currentUser")
+    }
     func get() -> AnyObject? {
         return user
     }
@@ -218,15 +373,19 @@ private class AXModelStatusObserver: AXModelObserver {
     init(model: AXModel, realtimeService: AXRealtimeService) {
         self.realtimeService = realtimeService
         self.realtimeService.on("status") { _ in
-            model.notify("change")
+            model.changed("status")
         }
     }
     
     func load() {}
+    func resync() {}
     func connect() {
         realtimeService.connect()
     }
-    func sort() {}
+    func update(objectID: String, affected: Set<String>, changedKeys: [String:Set<String>]) {}
+    func takeChangeEvent() -> AXModelEvent? {
+        return AXModelEvent(type: "change", name: "status")
+    }
     func get() -> AnyObject? {
         return realtimeService.statusString
     }
@@ -241,7 +400,17 @@ private class AXModelArrayObserver: AXModelObserver {
     private let order: String
     private let filter: String
     private let expand: Int
+    private let sortProperty: String
+    private let sortDirection: Int
     private var objects: [AXObject] = []
+    private var sortKeys: [AXModelSortKey] = []
+    private var positions: [String:Int] = [:]
+    private var changeSnapshot: [String]?
+    private var changeReloaded = false
+    private var updatedIDs = Set<String>()
+    private var removedObjects: [String:AXObject] = [:]
+    private var pendingChangedKeys: [String:Set<String>] = [:]
+    private var newestUpdated: String?
     private var connectedRelations: [String:Bool] = [:]
     private var expandedObjects: [String:Int] = [:]
     
@@ -252,22 +421,54 @@ private class AXModelArrayObserver: AXModelObserver {
         self.order = order ?? "-created"
         self.filter = filter ?? ""
         self.expand = expand ?? 0
+        
+        var property = self.order
+        var direction = 1
+        if property.characters.first == Character("-") {
+            property = property.substringFromIndex(property.startIndex.advancedBy(1))
+            direction = -1
+        }
+        switch property {
+            case "created": property = "sysCreated"
+            case "updated": property = "sysUpdated"
+            default: break
+        }
+        self.sortProperty = property
+        self.sortDirection = direction
     }
     
     private func set(objects: [AXObject]) {
-        self.objects = objects.map {
-            let x = model.normalize($0, depth: self.expand)
+        willChange()
+        changeReloaded = true
+        let normalized = objects.map { (object: AXObject) -> AXObject in
+            let x = model.normalize(object, depth: self.expand)
             self.registerRelations(x, depth: self.expand)
             return x
         }
-        sort()
-        model.notify("change")
+        let sorted = normalized.map({ ($0, sortKey($0)) }).sort({ self.ordered($0.1, $1.1) })
+        self.objects = sorted.map({ $0.0 })
+        self.sortKeys = sorted.map({ $0.1 })
+        newestUpdated = nil
+        self.objects.forEach(seen)
+        reindex()
     }
     
-    private func add(object: AXObject) {
-        objects.append(model.normalize(object))
-        sort()
-        model.notify("change")
+    private func add(object: AXObject, depth: Int = 0) {
+        let normalized = model.normalize(object, depth: depth)
+        if depth > 0 {
+            registerRelations(normalized, depth: depth)
+        }
+        if let id = normalized.objectID where positions[id] != nil {
+            update(id, affected: [id], changedKeys: model.store.changedKeys)
+            return
+        }
+        willChange()
+        seen(normalized)
+        let key = sortKey(normalized)
+        let index = insertionIndex(key)
+        objects.insert(normalized, atIndex: index)
+        sortKeys.insert(key, atIndex: index)
+        reindex(from: index)
     }
     
     private func update(object: AXObject) {
@@ -285,41 +486,200 @@ private class AXModelArrayObserver: AXModelObserver {
         }
     }
     
+    // Moves the updated object and the objects referring to it to their new positions,
+    // since the order may be by a property of a related object.
+    func update(objectID: String, affected: Set<String>, changedKeys: [String:Set<String>]) {
+        let held = affected.filter({ positions[$0] != nil })
+        if held.isEmpty {
+            return
+        }
+        willChange()
+        if let index = positions[objectID] {
+            seen(objects[index])
+        }
+        reposition(held)
+        held.forEach() { updatedIDs.insert($0) }
+        for (id, keys) in changedKeys {
+            pendingChangedKeys[id] = (pendingChangedKeys[id] ?? []).union(keys)
+        }
+    }
+    
+    // Takes out every object whose sort key changed before inserting them again, so
+    // the binary search only sees keys that are in order
+    private func reposition(ids: [String]) {
+        let moved = ids.flatMap({ positions[$0] })
+            .filter({ sortKey(objects[$0]) != sortKeys[$0] })
+            .sort(>)
+        if moved.isEmpty {
+            return
+        }
+        let removed = moved.map({ objects.removeAtIndex($0) })
+        moved.forEach() { sortKeys.removeAtIndex($0) }
+        var start = moved.last!
+        for object in removed {
+            let key = sortKey(object)
+            let index = insertionIndex(key)
+            objects.insert(object, atIndex: index)
+            sortKeys.insert(key, atIndex: index)
+            start = min(start, index)
+        }
+        reindex(from: start)
+    }
+    
     private func remove(object: AXObject) {
-        if let index = objects.indexOf({ $0.objectID == object.objectID }) {
-            objects.removeAtIndex(index)
+        guard let id = object.objectID, let index = positions[id] else {
+            return
         }
-        sort()
-        model.notify("change")
+        willChange()
+        removedObjects[id] = objects.removeAtIndex(index)
+        sortKeys.removeAtIndex(index)
+        positions[id] = nil
+        reindex(from: index)
     }
     
-    private func sort() {
-        var property = order
-        var direction = 1
-        if order.characters.first == Character("-") {
-            property = order.substringFromIndex(order.startIndex.advancedBy(1))
-            direction = -1
+    private func seen(object: AXObject) {
+        if let updated = object.string("sysUpdated") where updated > (newestUpdated ?? "") {
+            newestUpdated = updated
         }
-        
-        switch property {
-            case "created": property = "sysCreated"
-            case "updated": property = "sysUpdated"
-            default: break
+    }
+    
+    private func reindex(from start: Int = 0) {
+        if start == 0 {
+            positions = [:]
         }
-        
-        if direction < 0 {
-            self.objects.sortInPlace() {
-                let v0 = $0.string(property) ?? ""
-                let v1 = $1.string(property) ?? ""
-                return v0 > v1
+        for index in start..<objects.count {
+            if let id = objects[index].objectID {
+                positions[id] = index
+            }
+        }
+    }
+    
+    // MARK: Change events
+    
+    private func willChange() {
+        if changeSnapshot == nil {
+            changeSnapshot = objects.map({ $0.objectID ?? "" })
+            model.changed(name)
+        }
+    }
+    
+    // Describes the changes since the previous event by comparing the array with
+    // how it was before the first change
+    func takeChangeEvent() -> AXModelEvent? {
+        guard let before = changeSnapshot else {
+            return nil
+        }
+        let event = AXModelEvent(type: "change", name: name, reloaded: changeReloaded)
+        if !changeReloaded {
+            addIndexes(event, before: before)
+        }
+        for (id, keys) in pendingChangedKeys where positions[id] != nil || removedObjects[id] == nil {
+            event.changedKeys[id] = keys.sort()
+        }
+        changeSnapshot = nil
+        changeReloaded = false
+        updatedIDs = []
+        removedObjects = [:]
+        pendingChangedKeys = [:]
+        if !event.reloaded && event.insertedIndexes.isEmpty && event.deletedIndexes.isEmpty &&
+           event.movedIndexes.isEmpty && event.updatedObjects.isEmpty {
+            return nil
+        }
+        return event
+    }
+    
+    // Objects outside the longest run that kept their relative order are reported as moved
+    private func addIndexes(event: AXModelEvent, before: [String]) {
+        var oldIndexes: [String:Int] = [:]
+        for (index, id) in before.enumerate() where id != "" {
+            oldIndexes[id] = index
+            if positions[id] == nil {
+                event.deletedIndexes.append(index)
+                if let object = removedObjects[id] {
+                    event.deletedObjects.append(object)
+                }
+            }
+        }
+        var kept: [(id: String, from: Int, to: Int)] = []
+        for (index, object) in objects.enumerate() {
+            guard let id = object.objectID else {
+                continue
+            }
+            if let from = oldIndexes[id] {
+                kept.append((id: id, from: from, to: index))
+            } else {
+                event.insertedIndexes.append(index)
+                event.insertedObjects.append(object)
+            }
+        }
+        let unmoved = increasingRun(kept.map({ $0.from }))
+        for (position, item) in kept.enumerate() {
+            if !unmoved.contains(position) {
+                event.movedIndexes[item.from] = item.to
+            } else if updatedIDs.contains(item.id) {
+                event.updatedIndexes.append(item.from)
             }
-        } else if direction > 0 {
-            self.objects.sortInPlace() {
-                let v0 = $0.string(property) ?? ""
-                let v1 = $1.string(property) ?? ""
-                return v0 < v1
+            if updatedIDs.contains(item.id) {
+                event.updatedObjects.append(objects[item.to])
+            }
+        }
+        event.updatedIndexes.sortInPlace()
+    }
+    
+    // Positions of a longest increasing subsequence
+    private func increasingRun(sequence: [Int]) -> Set<Int> {
+        var tails: [Int] = []
+        var previous = [Int](count: sequence.count, repeatedValue: -1)
+        for (position, value) in sequence.enumerate() {
+            var low = 0
+            var high = tails.count
+            while low < high {
+                let mid = (low + high) / 2
+                if sequence[tails[mid]] < value {
+                    low = mid + 1
+                } else {
+                    high = mid
+                }
+            }
+            if low > 0 {
+                previous[position] = tails[low - 1]
+            }
+            if low == tails.count {
+                tails.append(position)
+            } else {
+                tails[low] = position
             }
         }
+        var result = Set<Int>()
+        var position = tails.last ?? -1
+        while position >= 0 {
+            result.insert(position)
+            position = previous[position]
+        }
+        return result
+    }
+    
+    private func sortKey(object: AXObject) -> AXModelSortKey {
+        return AXModelSortKey(object.value(sortProperty))
+    }
+    
+    private func ordered(key0: AXModelSortKey, _ key1: AXModelSortKey) -> Bool {
+        return sortDirection > 0 ? key0.isBefore(key1) : key1.isBefore(key0)
+    }
+    
+    // Binary search for the index after all objects that do not sort after the key
+    private func insertionIndex(key: AXModelSortKey) -> Int {
+        var low = 0
+        var high = sortKeys.count
+        while low < high {
+            let mid = (low + high) / 2
+            if ordered(key, sortKeys[mid]) {
+                high = mid
+            } else {
+                low = mid + 1
+            }
+        }
+        return low
     }
     
     func get() -> AnyObject? {
@@ -338,6 +698,36 @@ private class AXModelArrayObserver: AXModelObserver {
         }
     }
     
+    // Loads the objects updated since the newest one seen, including the newest one
+    // itself in case others were updated in the same instant. Filtered and expanded
+    // arrays are reloaded, since a delta query misses objects that stopped matching
+    // the filter and related objects that changed without their parent.
+    func resync() {
+        guard let since = newestUpdated where filter == "" && expand == 0 else {
+            load()
+            return
+        }
+        AXObject.find(collection, queryString: "sysUpdated>='\(since)'", options: [:]) {
+            objects, error in
+            if let error = error {
+                self.model.notify(AXModelEvent(type: "error", error: error.userInfo["errorMessage"] as? String))
+            } else {
+                objects?.forEach() {
+                    self.merge($0)
+                }
+            }
+        }
+    }
+    
+    private func merge(object: AXObject) {
+        if let id = object.objectID where positions[id] != nil {
+            model.update(object, depth: expand)
+            registerRelations(object, depth: expand)
+        } else {
+            add(object, depth: expand)
+        }
+    }
+    
     func handleLoadCompleted(objects:[AXObject]?, error:NSError?) {
         if let error = error {
             self.model.notify(AXModelEvent(type: "error", error: error.userInfo["errorMessage"] as? String))
@@ -393,3 +783,50 @@ private class AXModelArrayObserver: AXModelObserver {
     }
     
 }
+
+// Sort keys are computed once per object change rather than on every comparison.
+// Numbers and dates compare by value, and sort before strings. Missing values
+// sort first, like empty strings did. Server timestamps are ISO 8601 strings,
+// which already sort in time order as strings.
+private enum AXModelSortKey: Equatable {
+    
+    case Missing
+    case Number(Double)
+    case Date(NSTimeInterval)
+    case Text(String)
+    
+    init(_ value: AnyObject?) {
+        if let number = value as? NSNumber {
+            self = .Number(number.doubleValue)
+        } else if let date = value as? NSDate {
+            self = .Date(date.timeIntervalSinceReferenceDate)
+        } else if let string = value as? String where string != "" {
+            self = .Text(string)
+        } else {
+            self = .Missing
+        }
+    }
+    
+    private var rank: Int {
+        switch self {
+            case .Missing: return 0
+            case .Number: return 1
+            case .Date: return 2
+            case .Text: return 3
+        }
+    }
+    
+    func isBefore(other: AXModelSortKey) -> Bool {
+        switch (self, other) {
+            case let (.Number(a), .Number(b)): return a < b
+            case let (.Date(a), .Date(b)): return a < b
+            case let (.Text(a), .Text(b)): return a < b
+            default: return rank < other.rank
+        }
+    }
+
+}
+
+private func == (lhs: AXModelSortKey, rhs: AXModelSortKey) -> Bool {
+    return !lhs.isBefore(rhs) && !rhs.isBefore(lhs)
+}
@@ -0,0 +1,162 @@
+
+import Foundation
+
+internal class AXMultipartBody {
+    
+    private struct Part {
+        let header: String
+        let data: NSData?
+        let path: String?
+    }
+    
+    let boundary: String
+    private var parts: [Part] = []
+    private let chunkSize = 64 * 1024
+    
+    init() {
+        boundary = "Boundary-\(NSUUID().UUIDString)"
+    }
+    
+    var contentType: String {
+        get {
+            return "multipart/form-data; boundary=\(boundary)"
+        }
+    }
+    
+    var isStreamed: Bool {
+        get {
+            return parts.contains({ $0.path != nil })
+        }
+    }
+    
+    var headersDescription: String {
+        get {
+            return parts.map({ $0.header }).joinWithSeparator("")
+        }
+    }
+    
+    func appendPart(partName: String, part partSource: AnyObject) {
+        let part = partSource as? [String:AnyObject] ?? [:]
+        let filename = part["filename"] as? String ?? ""
+        let mimeType = part["mimeType"] as? String ?? ""
+        var header = "--\(boundary)\r\n"
+        if filename != "" {
+            header += "Content-Disposition: form-data; name=\"\(partName)\"; filename=\"\(filename)\"\r\n"
+        } else {
+            header += "Content-Disposition: form-data; name=\"\(partName)\"\r\n"
+        }
+        if mimeType != "" {
+            header += "Content-Type: \(mimeType)\r\n"
+        }
+        header += "\r\n"
+        parts.append(Part(header: header, data: part["data"] as? NSData, path: part["path"] as? String))
+    }
+    
+    func data() -> NSData {
+        let body = NSMutableData()
+        for part in parts {
+            body.appendData(stringData(part.header))
+            if let data = part.data {
+                body.appendData(data)
+            } else if let path = part.path, data = NSData(contentsOfFile: path) {
+                body.appendData(data)
+            }
+            body.appendData(stringData("\r\n"))
+        }
+        body.appendData(stringData("--\(boundary)--\r\n"))
+        return body
+    }
+    
+    // Spools the body to a temporary file on a background queue and calls completion on
+    // the main queue. Streams are used rather than NSFileHandle, which raises an exception
+    // instead of returning an error when the disk is full.
+    func writeToTemporaryFile(completion: (NSURL?, NSError?) -> ()) {
+        let path = (NSTemporaryDirectory() as NSString).stringByAppendingPathComponent("appstax-multipart-\(NSUUID().UUIDString)")
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)) {
+            let error = self.writeToFile(path)
+            if error != nil {
+                _ = try? NSFileManager.defaultManager().removeItemAtPath(path)
+            }
+            dispatch_async(dispatch_get_main_queue()) {
+                completion(error == nil ? NSURL(fileURLWithPath: path) : nil, error)
+            }
+        }
+    }
+    
+    private func writeToFile(path: String) -> NSError? {
+        guard let output = NSOutputStream(toFileAtPath: path, append: false) else {
+            return writeError("Unable to create multipart request body", streamError: nil)
+        }
+        output.open()
+        defer {
+            output.close()
+        }
+        for part in parts {
+            var ok = write(stringData(part.header), to: output)
+            if let data = part.data {
+                ok = ok && write(data, to: output)
+            } else if let path = part.path {
+                if let error = copyFile(path, to: output) {
+                    return error
+                }
+            }
+            ok = ok && write(stringData("\r\n"), to: output)
+            if !ok {
+                return writeError("Unable to write multipart request body", streamError: output.streamError)
+            }
+        }
+        if !write(stringData("--\(boundary)--\r\n"), to: output) {
+            return writeError("Unable to write multipart request body", streamError: output.streamError)
+        }
+        return nil
+    }
+    
+    private func copyFile(path: String, to output: NSOutputStream) -> NSError? {
+        guard let input = NSInputStream(fileAtPath: path) else {
+            return writeError("Unable to read file for multipart body: \(path)", streamError: nil)
+        }
+        input.open()
+        defer {
+            input.close()
+        }
+        let buffer = NSMutableData(length: chunkSize)!
+        while true {
+            let length = input.read(UnsafeMutablePointer<UInt8>(buffer.mutableBytes), maxLength: chunkSize)
+            if length < 0 {
+                return writeError("Unable to read file for multipart body: \(path)", streamError: input.streamError)
+            }
+            if length == 0 {
+                return nil
+            }
+            if !write(buffer.subdataWithRange(NSMakeRange(0, length)), to: output) {
+                return writeError("Unable to write multipart request body", streamError: output.streamError)
+            }
+        }
+    }
+    
+    // Writes all of data, since a stream may accept only part of it at a time
+    private func write(data: NSData, to output: NSOutputStream) -> Bool {
+        var offset = 0
+        while offset < data.length {
+            let written = output.write(UnsafePointer<UInt8>(data.bytes) + offset, maxLength: data.length - offset)
+            if written <= 0 {
+                return false
+            }
+            offset += written
+        }
+        return true
+    }
+    
+    private func writeError(description: String, streamError: NSError?) -> NSError {
+        var userInfo: [String:AnyObject] = [NSLocalizedDescriptionKey: description]
+        if let streamError = streamError {
+            userInfo[NSUnderlyingErrorKey] = streamError
+        }
+        return NSError(domain: "ApiClientError", code: 0, userInfo: userInfo)
+    }
+    
+    private func stringData(string: String) -> NSData {
+        return string.dataUsingEncoding(NSUTF8StringEncoding, allowLossyConversion: false)!
+    }
+
+}
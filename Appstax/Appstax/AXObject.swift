@@ -27,6 +27,7 @@ internal struct Relation {
     private var grants: [[String:AnyObject]]
     private var revokes: [[String:AnyObject]]
     internal var relations: [String:Relation]
+    private var changedKeys = Set<String>()
     
     internal convenience init(collectionName: String) {
         self.init(collectionName: collectionName, properties: [:], status:.New)
@@ -130,7 +131,7 @@ internal struct Relation {
         return value(path) as? [AXObject]
     }
     
-    private func value(path: String) -> AnyObject? {
+    internal func value(path: String) -> AnyObject? {
         var current = self
         for key in (path.characters.split { $0 == "." }.map { String($0) }) {
             if let next = current[key] as? AXObject {
@@ -157,6 +158,7 @@ internal struct Relation {
         }
         set(value) {
             properties[key] = value
+            changedKeys.insert(key)
             status = .Modified
         }
     }
@@ -193,6 +195,61 @@ internal struct Relation {
         }
     }
     
+    /// All properties for new objects. For saved objects only the properties set since
+    /// the object was loaded or saved, relations with changes, and the identifying properties.
+    /// Mutable arrays and dictionaries can be changed in place, so they are always included.
+    /// Properties set to nil are sent as null so they are cleared on the server.
+    internal var propertiesForSaving: [String:AnyObject] {
+        get {
+            let all = allPropertiesForSaving
+            if objectID == nil {
+                return all
+            }
+            var result: [String:AnyObject] = [:]
+            for (key, value) in all {
+                if relations[key] != nil {
+                    let changes = value["sysRelationChanges"] as? [String:[String]] ?? [:]
+                    if changes.values.contains({ !$0.isEmpty }) {
+                        result[key] = value
+                    }
+                } else if changedKeys.contains(key) || key == "sysObjectId" || key == "sysUsername" ||
+                          properties[key] is NSMutableArray || properties[key] is NSMutableDictionary {
+                    result[key] = value
+                }
+            }
+            for key in changedKeys where properties[key] == nil && relations[key] == nil {
+                result[key] = NSNull()
+            }
+            return result
+        }
+    }
+    
+    // Keys stay changed if they were set again while the save was in flight
+    private func clearChangedKeys(savedProperties: [String:AnyObject]) {
+        for key in Array(changedKeys) {
+            let current = properties[key]
+            guard let saved = savedProperties[key] else {
+                if current == nil && savedProperties["sysObjectId"] == nil {
+                    changedKeys.remove(key)
+                }
+                continue
+            }
+            if current == nil {
+                if saved is NSNull {
+                    changedKeys.remove(key)
+                }
+                continue
+            }
+            if let file = current as? AXFile {
+                if file.filename == saved["filename"] as? String {
+                    changedKeys.remove(key)
+                }
+            } else if relations[key] != nil || current === saved || (current as? NSObject)?.isEqual(saved) == true {
+                changedKeys.remove(key)
+            }
+        }
+    }
+    
     internal var allFileProperties: [String:AXFile] {
         get {
             var result: [String:AXFile] = [:]
@@ -336,6 +393,7 @@ internal struct Relation {
     }
     
     internal func afterSave(savedProperties: [String:AnyObject], completion: ((NSError?) -> ())?) {
+        self.clearChangedKeys(savedProperties)
         self.applyRelationChanges(savedProperties)
         self.savePermissionChanges(completion)
     }
@@ -345,76 +403,7 @@ internal struct Relation {
     }
     
     public func saveAll(completion: ((NSError?) -> ())?) {
-        saveObjectsInGraph(completion)
-    }
-    
-    private func saveObjectsInGraph(completion: ((NSError?) -> ())?) {
-        let objects = getObjectGraph()
-        let unsavedInbound = objects["inbound"]!.filter({ $0.isUnsaved })
-        let outbound = objects["outbound"]!
-        let remaining = objects["inbound"]!.filter({
-            !unsavedInbound.contains($0) &&
-            !outbound.contains($0)
-        })
-        
-        if 0 == outbound.count + unsavedInbound.count + remaining.count {
-            save(completion)
-            return
-        }
-        
-        objectService.saveObjects(unsavedInbound) {
-            error in
-            if error != nil {
-                completion?(error)
-                return
-            }
-            self.objectService.saveObjects(outbound) {
-                error in
-                if error != nil {
-                    completion?(error)
-                    return
-                }
-                self.objectService.saveObjects(remaining, completion:completion)
-            }
-        }
-    }
-    
-    private func getObjectGraph() -> [String:[AXObject]] {
-        var queue:    [AXObject]        = [self];
-        var all:      [String:AXObject] = [:]
-        var inbound:  [String:AXObject] = [:]
-        var outbound: [String:AXObject] = [:]
-        var allOrdered:      [AXObject] = []
-        var inboundOrdered:  [AXObject] = []
-        var outboundOrdered: [AXObject] = []
-        
-        while queue.count > 0 {
-            let object = queue.removeAtIndex(0)
-            if all[object.internalID] == nil {
-                all[object.internalID] = object
-                allOrdered.append(object)
-                let allRelated = object.getRelatedObjects()
-                for related in allRelated {
-                    if inbound[related.internalID] == nil {
-                        inbound[related.internalID] = related
-                        inboundOrdered.append(related)
-                    }
-                }
-                if allRelated.count > 0 {
-                    if outbound[object.internalID] == nil {
-                        outbound[object.internalID] = object
-                        outboundOrdered.append(object)
-                    }
-                    queue += allRelated
-                }
-            }
-        }
-        
-        return [
-            "all": allOrdered,
-            "inbound": inboundOrdered,
-            "outbound": outboundOrdered
-        ]
+        AXObjectGraphSaver(root: self, objectService: objectService).save(completion)
     }
     
     internal func getRelatedObjects() -> [AXObject] {
@@ -435,6 +424,12 @@ internal struct Relation {
             completion?(nil)
             return
         }
+        if let writeQueue = objectService.writeQueue where objectID == nil {
+            writeQueue.enqueuePermissions(grants, revokes: revokes, objectID: nil, localID: internalID, completion: completion)
+            grants.removeAll()
+            revokes.removeAll()
+            return
+        }
         permissionsService.grant(grants, revoke: revokes, objectID: objectID) {
             error in
             if error == nil {
@@ -484,6 +479,7 @@ internal struct Relation {
     internal func importValues(from: AXObject?) {
         for (key, value) in from?.allProperties ?? [:] {
             self.properties[key] = value
+            self.changedKeys.remove(key)
         }
     }
     
@@ -540,6 +536,14 @@ internal struct Relation {
         Appstax.defaultContext.objectService.findAll(collectionName, options: options, completion: completion)
     }
     
+    public static func cursor(collectionName: String, pageSize: Int) -> AXObjectCursor {
+        return Appstax.defaultContext.objectService.cursor(collectionName, options: nil, pageSize: pageSize)
+    }
+    
+    public static func cursor(collectionName: String, options: [String:AnyObject], pageSize: Int) -> AXObjectCursor {
+        return Appstax.defaultContext.objectService.cursor(collectionName, options: options, pageSize: pageSize)
+    }
+    
     public static func find(collectionName: String, withId: String, options: [String:AnyObject], completion: ((AXObject?, NSError?) -> ())?) {
         Appstax.defaultContext.objectService.find(collectionName, withId: withId, options: options, completion: completion)
     }
@@ -0,0 +1,323 @@
+
+import Foundation
+
+/// Persistent cache of query results used by AXObjectService to return
+/// previously loaded objects immediately while revalidating with the server.
+///
+/// Object properties are stored once per collection and sysObjectId, and are
+/// only replaced by a version with the same or a newer sysUpdated. Queries are
+/// keyed by their request url, which covers the collection, filter and query
+/// parameters. When more than maxObjectCount objects are cached, the least
+/// recently used queries are evicted along with objects no other query uses.
+///
+/// Changes are appended to a log file on a background queue. The log is
+/// replayed on the same queue when the cache is created, and whenLoaded runs
+/// code on the main queue once that is done. The log is compacted when it
+/// holds more than twice as many records as there are live entries.
+///
+/// Cached objects may be private to the user who loaded them, so Appstax
+/// removes everything when a user logs in, signs up or logs out.
+@objc public class AXObjectCache: NSObject {
+    
+    private struct CachedQuery {
+        var objectKeys: [String]
+        var accessed: Int
+    }
+    
+    public var maxObjectCount = 2000 {
+        didSet {
+            if loaded {
+                evict()
+            }
+        }
+    }
+    
+    private let path: String
+    private let ioQueue = dispatch_queue_create("com.appstax.objectcache", DISPATCH_QUEUE_SERIAL)
+    private var objects: [String:[String:AnyObject]] = [:]
+    private var objectReferences: [String:Int] = [:]
+    private var queries: [String:CachedQuery] = [:]
+    private var accessCounter = 0
+    private var logRecordCount = 0
+    private var loaded = false
+    private var loadWaiters: [() -> ()] = []
+    
+    public convenience init(appKey: String) {
+        let caches = NSSearchPathForDirectoriesInDomains(.CachesDirectory, .UserDomainMask, true).first ?? NSTemporaryDirectory()
+        let directory = (caches as NSString).stringByAppendingPathComponent("Appstax")
+        _ = try? NSFileManager.defaultManager().createDirectoryAtPath(directory, withIntermediateDirectories: true, attributes: nil)
+        self.init(path: (directory as NSString).stringByAppendingPathComponent("ObjectCache-\(appKey).log"))
+    }
+    
+    public init(path: String) {
+        self.path = path
+        super.init()
+        dispatch_async(ioQueue) {
+            self.readLog()
+            dispatch_async(dispatch_get_main_queue()) {
+                self.load()
+            }
+        }
+    }
+    
+    /// Runs block on the main queue when the log has been replayed, without blocking
+    public func whenLoaded(block: () -> ()) {
+        if loaded {
+            block()
+        } else {
+            loadWaiters.append(block)
+        }
+    }
+    
+    public var objectCount: Int {
+        get {
+            load()
+            return objects.count
+        }
+    }
+    
+    public func propertiesForQuery(url: NSURL) -> [[String:AnyObject]]? {
+        load()
+        let key = url.absoluteString
+        guard let query = queries[key] else {
+            return nil
+        }
+        accessCounter += 1
+        queries[key]?.accessed = accessCounter
+        return query.objectKeys.flatMap({ objects[$0] })
+    }
+    
+    public func storeProperties(properties: [[String:AnyObject]], collectionName: String, forQuery url: NSURL) {
+        load()
+        var objectKeys: [String] = []
+        for objectProperties in properties {
+            guard let id = objectProperties["sysObjectId"] as? String else {
+                removeQuery(url.absoluteString)
+                return
+            }
+            objectKeys.append(objectKey(collectionName, id: id))
+        }
+        for (index, key) in objectKeys.enumerate() {
+            storeObject(key, properties: properties[index])
+        }
+        setQuery(url.absoluteString, objectKeys: objectKeys)
+        evict()
+        compactIfNeeded()
+    }
+    
+    public func removeObject(collectionName: String, id: String) {
+        load()
+        let key = objectKey(collectionName, id: id)
+        if objects[key] == nil {
+            return
+        }
+        for (queryKey, query) in queries where query.objectKeys.contains(key) {
+            setQuery(queryKey, objectKeys: query.objectKeys.filter({ $0 != key }))
+        }
+        objects.removeValueForKey(key)
+        objectReferences.removeValueForKey(key)
+    }
+    
+    public func removeAll() {
+        load()
+        objects = [:]
+        objectReferences = [:]
+        queries = [:]
+        logRecordCount = 0
+        let path = self.path
+        dispatch_async(ioQueue) {
+            _ = try? NSFileManager.defaultManager().removeItemAtPath(path)
+        }
+    }
+    
+    internal static func isCurrent(cached: [[String:AnyObject]], fresh: [[String:AnyObject]]) -> Bool {
+        if cached.count != fresh.count {
+            return false
+        }
+        for (index, properties) in cached.enumerate() {
+            if !(properties as NSDictionary).isEqualToDictionary(fresh[index]) {
+                return false
+            }
+        }
+        return true
+    }
+    
+    internal func waitUntilWritten() {
+        dispatch_sync(ioQueue) {}
+    }
+    
+    private func objectKey(collectionName: String, id: String) -> String {
+        return "\(collectionName)/\(id)"
+    }
+    
+    private func storeObject(key: String, properties: [String:AnyObject]) {
+        if let existing = objects[key] where isNewer(existing["sysUpdated"], than: properties["sysUpdated"]) {
+            return
+        }
+        objects[key] = properties
+        appendRecord(["object": key, "properties": properties])
+    }
+    
+    private func isNewer(value: AnyObject?, than other: AnyObject?) -> Bool {
+        if let number = value as? NSNumber, otherNumber = other as? NSNumber {
+            return number.compare(otherNumber) == .OrderedDescending
+        }
+        if let string = value as? String, otherString = other as? String {
+            return string > otherString
+        }
+        return false
+    }
+    
+    private func setQuery(key: String, objectKeys: [String]) {
+        applyQuery(key, objectKeys: objectKeys)
+        appendRecord(["query": key, "objects": objectKeys])
+    }
+    
+    private func removeQuery(key: String) {
+        if queries[key] != nil {
+            applyQuery(key, objectKeys: nil)
+            appendRecord(["removeQuery": key])
+        }
+    }
+    
+    private func applyQuery(key: String, objectKeys: [String]?) {
+        let previous = queries[key]
+        if let objectKeys = objectKeys {
+            accessCounter += 1
+            queries[key] = CachedQuery(objectKeys: objectKeys, accessed: accessCounter)
+            for objectKey in objectKeys {
+                objectReferences[objectKey] = (objectReferences[objectKey] ?? 0) + 1
+            }
+        } else {
+            queries.removeValueForKey(key)
+        }
+        for objectKey in previous?.objectKeys ?? [] {
+            releaseObject(objectKey)
+        }
+    }
+    
+    private func releaseObject(key: String) {
+        let references = (objectReferences[key] ?? 1) - 1
+        if references > 0 {
+            objectReferences[key] = references
+        } else {
+            objectReferences.removeValueForKey(key)
+            objects.removeValueForKey(key)
+        }
+    }
+    
+    private func evict() {
+        while objects.count > maxObjectCount && !queries.isEmpty {
+            var oldestKey = ""
+            var oldestAccess = Int.max
+            for (key, query) in queries where query.accessed < oldestAccess {
+                oldestKey = key
+                oldestAccess = query.accessed
+            }
+            removeQuery(oldestKey)
+        }
+    }
+    
+    // MARK: Log file
+    
+    // Only waits for the replay when the cache is used before whenLoaded has fired
+    private func load() {
+        if loaded {
+            return
+        }
+        dispatch_sync(ioQueue) {}
+        loaded = true
+        for key in objects.keys.filter({ objectReferences[$0] == nil }) {
+            objects.removeValueForKey(key)
+        }
+        evict()
+        AXLog.debug("Loaded \(queries.count) cached queries with \(objects.count) objects")
+        let waiters = loadWaiters
+        loadWaiters = []
+        waiters.forEach() { $0() }
+    }
+    
+    // Runs on ioQueue before anything else touches the cache contents
+    private func readLog() {
+        guard let data = NSData(contentsOfFile: path) else {
+            return
+        }
+        let newline = "\n".dataUsingEncoding(NSUTF8StringEncoding)!
+        var start = 0
+        while start < data.length {
+            let remaining = NSMakeRange(start, data.length - start)
+            let end = data.rangeOfData(newline, options: [], range: remaining).location
+            let lineEnd = end == NSNotFound ? data.length : end
+            autoreleasepool {
+                let line = data.subdataWithRange(NSMakeRange(start, lineEnd - start))
+                if let record = (try? NSJSONSerialization.JSONObjectWithData(line, options: [])) as? [String:AnyObject] {
+                    self.replayRecord(record)
+                }
+            }
+            start = lineEnd + 1
+        }
+    }
+    
+    private func replayRecord(record: [String:AnyObject]) {
+        logRecordCount += 1
+        if let key = record["object"] as? String, properties = record["properties"] as? [String:AnyObject] {
+            objects[key] = properties
+        } else if let key = record["query"] as? String, objectKeys = record["objects"] as? [String] {
+            applyQuery(key, objectKeys: objectKeys.filter({ objects[$0] != nil }))
+        } else if let key = record["removeQuery"] as? String {
+            applyQuery(key, objectKeys: nil)
+        }
+    }
+    
+    private func appendRecord(record: [String:AnyObject]) {
+        guard let data = lineData(record) else {
+            return
+        }
+        logRecordCount += 1
+        let path = self.path
+        dispatch_async(ioQueue) {
+            if !NSFileManager.defaultManager().fileExistsAtPath(path) {
+                NSFileManager.defaultManager().createFileAtPath(path, contents: nil, attributes: nil)
+            }
+            if let output = NSFileHandle(forWritingAtPath: path) {
+                output.seekToEndOfFile()
+                output.writeData(data)
+                output.closeFile()
+            }
+        }
+    }
+    
+    private func compactIfNeeded() {
+        if logRecordCount <= 2 * (objects.count + queries.count) + 100 {
+            return
+        }
+        let snapshot = NSMutableData()
+        for (key, properties) in objects {
+            if let data = lineData(["object": key, "properties": properties]) {
+                snapshot.appendData(data)
+            }
+        }
+        for (key, query) in queries.sort({ $0.1.accessed < $1.1.accessed }) {
+            if let data = lineData(["query": key, "objects": query.objectKeys]) {
+                snapshot.appendData(data)
+            }
+        }
+        logRecordCount = objects.count + queries.count
+        let path = self.path
+        dispatch_async(ioQueue) {
+            if !snapshot.writeToFile(path, atomically: true) {
+                AXLog.warn("Unable to compact object cache at \(path)")
+            }
+        }
+    }
+    
+    private func lineData(record: [String:AnyObject]) -> NSData? {
+        guard let json = try? NSJSONSerialization.dataWithJSONObject(record, options: []) else {
+            return nil
+        }
+        let line = NSMutableData(data: json)
+        line.appendData("\n".dataUsingEncoding(NSUTF8StringEncoding)!)
+        return line
+    }
+
+}
@@ -0,0 +1,128 @@
+
+import Foundation
+
+/// Walks through a collection one page at a time, so large collections can be
+/// processed without holding all of the objects in memory.
+///
+/// While a page is being handled, up to maxPrefetchedPages of the following pages
+/// are loaded in the background, so no more than (1 + maxPrefetchedPages) * pageSize
+/// objects are held by the cursor at any time. The cursor is finished after
+/// a page with fewer than pageSize objects. Completion handlers are called on the main queue.
+public class AXObjectCursor {
+    
+    public let collectionName: String
+    public let pageSize: Int
+    public var maxPrefetchedPages = 1
+    public private(set) var isFinished = false
+    public private(set) var isCancelled = false
+    
+    private let objectService: AXObjectService
+    private let options: [String:AnyObject]?
+    private var nextPageNumber: Int
+    private var loading = false
+    private var loadedLastPage = false
+    private var prefetchedPages: [[AXObject]] = []
+    private var error: NSError?
+    private var waitingCompletion: (([AXObject]?, NSError?) -> ())?
+    
+    internal init(collectionName: String, options: [String:AnyObject]?, pageSize: Int, objectService: AXObjectService) {
+        self.collectionName = collectionName
+        self.options = options
+        self.pageSize = max(pageSize, 1)
+        self.objectService = objectService
+        self.nextPageNumber = options?["page"] as? Int ?? 0
+    }
+    
+    /// Calls completion with the next page of objects, or with nil when there are no more pages
+    public func nextPage(completion: ([AXObject]?, NSError?) -> ()) {
+        if isCancelled || isFinished {
+            deliver(nil, error: nil, completion: completion)
+        } else if !prefetchedPages.isEmpty {
+            deliver(prefetchedPages.removeFirst(), error: nil, completion: completion)
+            prefetch()
+        } else if let error = error {
+            self.error = nil
+            deliver(nil, error: error, completion: completion)
+        } else if loadedLastPage {
+            isFinished = true
+            deliver(nil, error: nil, completion: completion)
+        } else {
+            waitingCompletion = completion
+            prefetch()
+        }
+    }
+    
+    /// Calls handler for each page. The handler calls next() when it is done with the page,
+    /// and completion is called after the last page, after an error, or when the cursor is cancelled.
+    public func forEachPage(handler: ([AXObject], next: () -> ()) -> (), completion: ((NSError?) -> ())?) {
+        nextPage() {
+            objects, error in
+            if let objects = objects {
+                handler(objects) {
+                    self.forEachPage(handler, completion: completion)
+                }
+            } else {
+                completion?(error)
+            }
+        }
+    }
+    
+    public func forEach(handler: (AXObject) -> (), completion: ((NSError?) -> ())?) {
+        forEachPage({
+            objects, next in
+            objects.forEach(handler)
+            next()
+        }, completion: completion)
+    }
+    
+    /// Stops loading pages and releases prefetched objects
+    public func cancel() {
+        isCancelled = true
+        prefetchedPages = []
+        if let completion = waitingCompletion {
+            waitingCompletion = nil
+            deliver(nil, error: nil, completion: completion)
+        }
+    }
+    
+    private func prefetch() {
+        if loading || loadedLastPage || isCancelled || error != nil {
+            return
+        }
+        if waitingCompletion == nil && prefetchedPages.count >= maxPrefetchedPages {
+            return
+        }
+        loading = true
+        let pageNumber = nextPageNumber
+        nextPageNumber += 1
+        objectService.findPage(collectionName, options: options, page: pageNumber, pageSize: pageSize) {
+            objects, error in
+            self.loading = false
+            if self.isCancelled {
+                return
+            }
+            if let objects = objects where error == nil {
+                self.loadedLastPage = objects.count < self.pageSize
+                if objects.count > 0 {
+                    self.prefetchedPages.append(objects)
+                }
+            } else {
+                self.error = error ?? NSError(domain: "AXObjectError", code: 0, userInfo: [NSLocalizedDescriptionKey: "Unable to load page \(pageNumber) of \(self.collectionName)"])
+                self.nextPageNumber = pageNumber
+            }
+            if let completion = self.waitingCompletion {
+                self.waitingCompletion = nil
+                self.nextPage(completion)
+            } else {
+                self.prefetch()
+            }
+        }
+    }
+    
+    private func deliver(objects: [AXObject]?, error: NSError?, completion: ([AXObject]?, NSError?) -> ()) {
+        dispatch_async(dispatch_get_main_queue()) {
+            completion(objects, error)
+        }
+    }
+
+}
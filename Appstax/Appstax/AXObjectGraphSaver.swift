@@ -0,0 +1,203 @@
+
+import Foundation
+
+/// Saves all objects reachable through relations from a root object.
+///
+/// An object depends on the related objects that do not have an objectID yet,
+/// and is saved as soon as all of those have been created. Independent objects
+/// are saved in parallel, with at most maxConcurrentSaveRequests saves in flight.
+/// Objects in dependency cycles are saved twice: first created without links to
+/// the other unsaved objects in the cycle, then saved again to add the links.
+internal class AXObjectGraphSaver {
+    
+    private let objectService: AXObjectService
+    private var objects: [AXObject] = []
+    private var dependencies: [[Int]] = []
+    private var dependents: [[Int]] = []
+    private var component: [Int] = []
+    private var cyclic: [Bool] = []
+    
+    private var remainingDependencies: [Int] = []
+    private var remainingExternalDependencies: [Int] = []
+    private var created: [Bool] = []
+    private var queuedCreate: [Bool] = []
+    private var queuedLink: [Bool] = []
+    private var queue: [(index: Int, link: Bool)] = []
+    private var queueHead = 0
+    private var inFlight = 0
+    private var savesRemaining = 0
+    private var firstError: NSError?
+    private var completion: ((NSError?) -> ())?
+    
+    init(root: AXObject, objectService: AXObjectService) {
+        self.objectService = objectService
+        buildGraph(root)
+        findCycles()
+    }
+    
+    func save(completion: ((NSError?) -> ())?) {
+        self.completion = completion
+        let count = objects.count
+        remainingDependencies = dependencies.map({ $0.count })
+        remainingExternalDependencies = (0..<count).map({
+            index in
+            return self.dependencies[index].filter({ self.component[$0] != self.component[index] }).count
+        })
+        created = [Bool](count: count, repeatedValue: false)
+        queuedCreate = [Bool](count: count, repeatedValue: false)
+        queuedLink = [Bool](count: count, repeatedValue: false)
+        savesRemaining = cyclic.reduce(0, combine: { $0 + ($1 ? 2 : 1) })
+        
+        for index in 0..<count {
+            enqueueIfReady(index)
+        }
+        startSaves()
+    }
+    
+    private func buildGraph(root: AXObject) {
+        var indexes: [String:Int] = [:]
+        func nodeIndex(object: AXObject) -> Int {
+            if let index = indexes[object.internalID] {
+                return index
+            }
+            let index = objects.count
+            indexes[object.internalID] = index
+            objects.append(object)
+            dependencies.append([])
+            dependents.append([])
+            return index
+        }
+        
+        nodeIndex(root)
+        var head = 0
+        while head < objects.count {
+            var seen = Set<Int>()
+            for related in objects[head].getRelatedObjects() {
+                let index = nodeIndex(related)
+                if related.isUnsaved && !seen.contains(index) {
+                    seen.insert(index)
+                    dependencies[head].append(index)
+                    dependents[index].append(head)
+                }
+            }
+            head += 1
+        }
+    }
+    
+    // Tarjan's strongly connected components, iterative to handle deep graphs
+    private func findCycles() {
+        let count = objects.count
+        component = [Int](count: count, repeatedValue: -1)
+        cyclic = [Bool](count: count, repeatedValue: false)
+        var order = [Int](count: count, repeatedValue: -1)
+        var lowlink = [Int](count: count, repeatedValue: 0)
+        var onStack = [Bool](count: count, repeatedValue: false)
+        var stack: [Int] = []
+        var counter = 0
+        var components = 0
+        
+        for start in 0..<count where order[start] < 0 {
+            order[start] = counter
+            lowlink[start] = counter
+            counter += 1
+            stack.append(start)
+            onStack[start] = true
+            var work: [(node: Int, next: Int)] = [(start, 0)]
+            
+            while !work.isEmpty {
+                let (node, next) = work[work.count - 1]
+                if next < dependencies[node].count {
+                    work[work.count - 1].next = next + 1
+                    let dependency = dependencies[node][next]
+                    if order[dependency] < 0 {
+                        order[dependency] = counter
+                        lowlink[dependency] = counter
+                        counter += 1
+                        stack.append(dependency)
+                        onStack[dependency] = true
+                        work.append((dependency, 0))
+                    } else if onStack[dependency] {
+                        lowlink[node] = min(lowlink[node], order[dependency])
+                    }
+                    continue
+                }
+                
+                work.removeLast()
+                if let parent = work.last?.node {
+                    lowlink[parent] = min(lowlink[parent], lowlink[node])
+                }
+                if lowlink[node] == order[node] {
+                    var members: [Int] = []
+                    repeat {
+                        let member = stack.removeLast()
+                        onStack[member] = false
+                        component[member] = components
+                        members.append(member)
+                    } while members.last != node
+                    let isCycle = members.count > 1 || dependencies[node].contains(node)
+                    for member in members {
+                        cyclic[member] = isCycle
+                    }
+                    components += 1
+                }
+            }
+        }
+    }
+    
+    private func enqueueIfReady(index: Int) {
+        if !queuedCreate[index] {
+            let waiting = cyclic[index] ? remainingExternalDependencies[index] : remainingDependencies[index]
+            if waiting == 0 {
+                queuedCreate[index] = true
+                queue.append((index, false))
+            }
+        } else if cyclic[index] && created[index] && !queuedLink[index] && remainingDependencies[index] == 0 {
+            queuedLink[index] = true
+            queue.append((index, true))
+        }
+    }
+    
+    private func startSaves() {
+        let limit = max(objectService.maxConcurrentSaveRequests, 1)
+        while firstError == nil && inFlight < limit && queueHead < queue.count {
+            let (index, link) = queue[queueHead]
+            queueHead += 1
+            inFlight += 1
+            objectService.saveObject(objects[index]) {
+                _, error in
+                self.inFlight -= 1
+                self.savesRemaining -= 1
+                if error != nil {
+                    self.firstError = self.firstError ?? error
+                } else if !link {
+                    self.didCreate(index)
+                }
+                self.startSaves()
+            }
+        }
+        if inFlight == 0 && (savesRemaining == 0 || firstError != nil || queueHead == queue.count) {
+            finish()
+        }
+    }
+    
+    private func didCreate(index: Int) {
+        created[index] = true
+        for dependent in dependents[index] {
+            remainingDependencies[dependent] -= 1
+            if component[dependent] != component[index] {
+                remainingExternalDependencies[dependent] -= 1
+            }
+            enqueueIfReady(dependent)
+        }
+        if cyclic[index] {
+            enqueueIfReady(index)
+        }
+    }
+    
+    private func finish() {
+        let completion = self.completion
+        self.completion = nil
+        completion?(firstError)
+    }
+
+}
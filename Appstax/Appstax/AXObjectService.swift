@@ -5,6 +5,33 @@ public class AXObjectService {
     
     private var apiClient: AXApiClient
     
+    /// Max number of objects per bulk request in saveObjects. 0 disables bulk saving.
+    public var saveBatchSize = 0
+    
+    /// Max number of save requests in flight at the same time in saveObjects
+    public var maxConcurrentSaveRequests = 6
+    
+    /// Cache of query results. When set, find and findAll call completion with
+    /// cached objects first, and again only if the server returns something else.
+    public var objectCache: AXObjectCache?
+    
+    /// When set, saves of objects without unsaved files and removes are stored in
+    /// the queue and sent from there, so they are kept while the device is offline.
+    public var writeQueue: AXWriteQueue?
+    
+    /// Queue that find and findAll call their completion handlers on
+    public var completionQueue = dispatch_get_main_queue()
+    
+    /// When above zero, find withId calls for the same collection and options made within
+    /// this many seconds are combined into one query. Not used when objectCache is set.
+    public var findByIdBatchWindow: NSTimeInterval = 0
+    
+    /// Max number of ids combined into one query by findByIdBatchWindow
+    public var maxFindByIdBatchSize = 50
+    
+    private let decodeQueue = dispatch_queue_create("com.appstax.objectservice.decode", DISPATCH_QUEUE_SERIAL)
+    private var pendingFindsById: [String:AXPendingFindsById] = [:]
+    
     public init(apiClient: AXApiClient) {
         self.apiClient = apiClient
     }
@@ -35,19 +62,19 @@ public class AXObjectService {
         if object.hasUnsavedRelations {
             let error = "Error saving object. Found unsaved related objects. Save related objects first or consider using saveAll instead."
             completion?(object, NSError(domain: "AXObjectError", code: 0, userInfo: [NSLocalizedDescriptionKey:error]))
-        } else {
+        } else if let writeQueue = writeQueue where !object.hasUnsavedFiles {
             object.status = .Saving
-            
-            let savedProperties = object.allPropertiesForSaving
-            let afterSave: ((AXObject, NSError?) -> ()) = {
-                object, error in
-                if error != nil {
-                    completion?(object, error)
-                } else {
-                    object.afterSave(savedProperties, completion: { completion?(object, $0) })
-                }
+            let properties = object.propertiesForSaving
+            writeQueue.enqueueSave(object, properties: properties) {
+                error in
+                object.status = error != nil || writeQueue.hasPendingWrites(object) ? .Modified : .Saved
+                self.afterSaveHandler(properties, completion: completion)(object, error)
             }
+        } else {
+            object.status = .Saving
             
+            let properties = object.propertiesForSaving
+            let afterSave = afterSaveHandler(properties, completion: completion)
             if object.objectID == nil {
                 if object.hasUnsavedFiles {
                     saveNewObjectWithFiles(object, completion: afterSave)
@@ -55,28 +82,43 @@ public class AXObjectService {
                     saveNewObjectWithoutFiles(object, completion: afterSave)
                 }
             } else {
-                updateObject(object, completion: afterSave)
+                updateObject(object, properties: properties, completion: afterSave)
             }
         }
     }
     
-    private func updateObject(object: AXObject, completion: ((AXObject, NSError?) -> ())?) {
+    private func afterSaveHandler(savedProperties: [String:AnyObject], completion: ((AXObject, NSError?) -> ())?) -> ((AXObject, NSError?) -> ()) {
+        return {
+            object, error in
+            if error != nil {
+                completion?(object, error)
+            } else {
+                object.afterSave(savedProperties, completion: { completion?(object, $0) })
+            }
+        }
+    }
+    
+    private func updateObject(object: AXObject, properties: [String:AnyObject], completion: ((AXObject, NSError?) -> ())?) {
         let url = urlForObject(object)
-        apiClient.putDictionary(object.allPropertiesForSaving, toUrl: url) {
+        apiClient.putDictionary(properties, toUrl: url) {
             dictionary, error in
             if error == nil {
-                let fileService = Appstax.defaultContext.fileService
-                fileService.saveFilesForObject(object) {
-                    error in
-                    object.status = error != nil ? .Modified : .Saved
-                    completion?(object, error)
-                }
+                self.saveFilesAfterUpdate(object, completion: completion)
             } else {
                 completion?(object, error)
             }
         }
     }
     
+    private func saveFilesAfterUpdate(object: AXObject, completion: ((AXObject, NSError?) -> ())?) {
+        let fileService = Appstax.defaultContext.fileService
+        fileService.saveFilesForObject(object) {
+            error in
+            object.status = error != nil ? .Modified : .Saved
+            completion?(object, error)
+        }
+    }
+    
     private func saveNewObjectWithoutFiles(object: AXObject, completion: ((AXObject, NSError?) -> ())?) {
         let url = urlForCollection(object.collectionName)
         apiClient.postDictionary(object.allPropertiesForSaving, toUrl: url) {
@@ -98,13 +140,8 @@ public class AXObjectService {
         
         for (key, file) in object.allFileProperties {
             file.status = AXFileStatusSaving
-            let data = fileService.dataForFile(file)
-            multipart[key] = [
-                "data": data,
-                "mimeType": file.mimeType,
-                "filename": file.filename
-            ]
-            AXLog.trace("Adding file to body: mimeType=\(file.mimeType), filename=\(file.filename), data=\(data.length) bytes")
+            multipart[key] = fileService.multipartForFile(file)
+            AXLog.trace("Adding file to body: mimeType=\(file.mimeType), filename=\(file.filename), dataPath=\(file.dataPath)")
         }
         
         let objectData = apiClient.serializeDictionary(object.allPropertiesForSaving)
@@ -128,51 +165,283 @@ public class AXObjectService {
     }
     
     public func saveObjects(objects: [AXObject], completion: ((NSError?) -> ())?) {
-        if objects.count == 0 {
-            completion?(nil)
+        saveObjects(objects, failures: {
+            failures in
+            completion?(objects.flatMap({ failures[$0] }).first)
+        })
+    }
+    
+    /// Saves objects with at most maxConcurrentSaveRequests requests in flight,
+    /// using bulk requests when saveBatchSize > 0. Failed objects are reported
+    /// with their errors when all objects are done.
+    public func saveObjects(objects: [AXObject], failures completion: (([AXObject:NSError]) -> ())?) {
+        var failures: [AXObject:NSError] = [:]
+        let onSaved: (AXObject, NSError?) -> () = {
+            object, error in
+            if let error = error {
+                failures[object] = error
+            }
+        }
+        
+        var tasks: [(() -> ()) -> ()] = []
+        var batchable: [String:[AXObject]] = [:]
+        for object in objects {
+            if saveBatchSize > 0 && canSaveInBatch(object) {
+                batchable[object.collectionName] = (batchable[object.collectionName] ?? []) + [object]
+            } else {
+                tasks.append({ done in self.saveObject(object) { onSaved($0, $1); done() } })
+            }
+        }
+        for (collectionName, collectionObjects) in batchable {
+            for start in 0.stride(to: collectionObjects.count, by: saveBatchSize) {
+                let batch = Array(collectionObjects[start..<min(start + saveBatchSize, collectionObjects.count)])
+                if batch.count == 1 {
+                    tasks.append({ done in self.saveObject(batch[0]) { onSaved($0, $1); done() } })
+                } else {
+                    tasks.append({ done in self.saveBatch(batch, collectionName: collectionName, objectCompletion: onSaved, completion: done) })
+                }
+            }
         }
         
-        var completionCount = 0
-        var firstError: NSError?
+        runTasks(tasks, maxConcurrent: maxConcurrentSaveRequests) {
+            completion?(failures)
+        }
+    }
+    
+    private func canSaveInBatch(object: AXObject) -> Bool {
+        return object.collectionName != "users" &&
+               !object.hasUnsavedRelations &&
+               !(object.objectID == nil && object.hasUnsavedFiles)
+    }
+    
+    private func saveBatch(objects: [AXObject], collectionName: String, objectCompletion: (AXObject, NSError?) -> (), completion: () -> ()) {
+        var savedProperties: [[String:AnyObject]] = []
         for object in objects {
-            saveObject(object) {
-                object, error in
-                completionCount += 1
-                if firstError == nil && error != nil {
-                    firstError = error
+            object.status = .Saving
+            savedProperties.append(object.propertiesForSaving)
+        }
+        
+        var remaining = objects.count
+        let objectDone: (AXObject, NSError?) -> () = {
+            objectCompletion($0, $1)
+            remaining -= 1
+            if remaining == 0 {
+                completion()
+            }
+        }
+        
+        let url = apiClient.urlFromTemplate("objects/:collection/bulk", parameters: ["collection": collectionName])!
+        apiClient.postDictionary(["objects": savedProperties], toUrl: url) {
+            dictionary, error in
+            let results = dictionary?["objects"] as? [[String:AnyObject]] ?? []
+            for (index, object) in objects.enumerate() {
+                let afterSave = self.afterSaveHandler(savedProperties[index], completion: objectDone)
+                let result: [String:AnyObject]? = index < results.count ? results[index] : nil
+                if let objectError = self.errorFromBatchResult(result, requestError: error) {
+                    object.status = .Modified
+                    afterSave(object, objectError)
+                } else if object.objectID == nil {
+                    if let objectID = result?["sysObjectId"] as? String {
+                        object.objectID = objectID
+                        object.status = .Saved
+                        afterSave(object, nil)
+                    } else {
+                        object.status = .Modified
+                        afterSave(object, NSError(domain: "AXObjectError", code: 0, userInfo: [NSLocalizedDescriptionKey: "Missing sysObjectId for new object in bulk save response"]))
+                    }
+                } else {
+                    self.saveFilesAfterUpdate(object, completion: afterSave)
                 }
-                if completionCount == objects.count {
-                    completion?(firstError)
+            }
+        }
+    }
+    
+    private func errorFromBatchResult(result: [String:AnyObject]?, requestError: NSError?) -> NSError? {
+        if requestError != nil {
+            return requestError
+        }
+        if let message = result?["errorMessage"] as? String {
+            let code = result?["errorCode"] as? Int ?? 0
+            return NSError(domain: "ApiClientHttpError", code: code, userInfo: ["errorMessage": message])
+        }
+        if result == nil {
+            return NSError(domain: "AXObjectError", code: 0, userInfo: [NSLocalizedDescriptionKey: "Missing result for object in bulk save response"])
+        }
+        return nil
+    }
+    
+    private func runTasks(tasks: [(() -> ()) -> ()], maxConcurrent: Int, completion: () -> ()) {
+        if tasks.count == 0 {
+            completion()
+            return
+        }
+        var next = 0
+        var finished = 0
+        var startNext: (() -> ())!
+        startNext = {
+            if next >= tasks.count {
+                return
+            }
+            let task = tasks[next]
+            next += 1
+            task() {
+                finished += 1
+                if finished == tasks.count {
+                    startNext = nil
+                    completion()
+                } else {
+                    startNext?()
                 }
             }
         }
+        for _ in 0..<min(max(maxConcurrent, 1), tasks.count) {
+            startNext?()
+        }
     }
     
     public func remove(object: AXObject, completion: ((NSError?) -> ())?) {
-        let url = urlForObject(object)
-        apiClient.deleteUrl(url, completion: completion)
+        if let id = object.objectID {
+            objectCache?.removeObject(object.collectionName, id: id)
+        }
+        if let writeQueue = writeQueue {
+            writeQueue.enqueueRemove(object) { completion?($0) }
+        } else {
+            apiClient.deleteUrl(urlForObject(object), completion: completion)
+        }
     }
     
     public func findAll(collectionName: String, options: [String:AnyObject]?, completion: (([AXObject]?, NSError?) -> ())?) {
         let url = urlForCollection(collectionName, queryParameters: queryParametersFromQueryOptions(options))
-        apiClient.dictionaryFromUrl(url) {
+        loadObjects(collectionName, url: url, extract: { $0?["objects"] as? [[String:AnyObject]] }) {
+            completion?($0 ?? [], $1)
+        }
+    }
+    
+    /// Loads all objects in a collection and delivers them in batches of batchSize objects,
+    /// so the first objects can be shown before the rest have been created.
+    /// Batches are not cached.
+    public func findAll(collectionName: String, options: [String:AnyObject]?, batchSize: Int, batch: ([AXObject]) -> (), completion: ((NSError?) -> ())?) {
+        let url = urlForCollection(collectionName, queryParameters: queryParametersFromQueryOptions(options))
+        let size = max(batchSize, 1)
+        apiClient.dictionaryFromUrl(url, queue: decodeQueue) {
             dictionary, error in
-            var objects: [AXObject] = []
-            if let properties = dictionary?["objects"] as? [[String:AnyObject]] {
-                objects = self.createObjects(collectionName, properties: properties, status: .Saved)
+            let properties = dictionary?["objects"] as? [[String:AnyObject]] ?? []
+            for start in 0.stride(to: properties.count, by: size) {
+                let objects = self.createObjects(collectionName, properties: Array(properties[start..<min(start + size, properties.count)]), status: .Saved)
+                dispatch_async(self.completionQueue) {
+                    batch(objects)
+                }
+            }
+            dispatch_async(self.completionQueue) {
+                completion?(error)
+            }
+        }
+    }
+    
+    /// Creates a cursor that loads the collection pageSize objects at a time
+    public func cursor(collectionName: String, options: [String:AnyObject]?, pageSize: Int) -> AXObjectCursor {
+        return AXObjectCursor(collectionName: collectionName, options: options, pageSize: pageSize, objectService: self)
+    }
+    
+    // Loads a single page for a cursor, bypassing the object cache and response revalidation
+    // so pages are released as soon as the cursor is done with them.
+    internal func findPage(collectionName: String, options: [String:AnyObject]?, page: Int, pageSize: Int, completion: ([AXObject]?, NSError?) -> ()) {
+        var pageOptions = options ?? [:]
+        pageOptions["page"] = page
+        pageOptions["pageSize"] = pageSize
+        let url = urlForCollection(collectionName, queryParameters: queryParametersFromQueryOptions(pageOptions))
+        apiClient.dictionaryFromUrl(url, queue: decodeQueue, validate: false) {
+            dictionary, error in
+            let properties = dictionary?["objects"] as? [[String:AnyObject]]
+            let objects = properties.map({ self.createObjects(collectionName, properties: $0, status: .Saved) })
+            dispatch_async(dispatch_get_main_queue()) {
+                completion(objects, error)
             }
-            completion?(objects, error)
         }
     }
     
     public func find(collectionName: String, withId id: String, options: [String:AnyObject]?, completion: ((AXObject?, NSError?) -> ())?) {
+        if findByIdBatchWindow > 0 && objectCache == nil {
+            addPendingFindById(collectionName, id: id, options: options) {
+                completion?($0, $1)
+            }
+            return
+        }
         let url = urlForObject(collectionName, withId: id, queryParameters: queryParametersFromQueryOptions(options))
-        apiClient.dictionaryFromUrl(url) {
+        loadObjects(collectionName, url: url, extract: { $0.map({ [$0] }) }) {
+            completion?($0?.first, $1)
+        }
+    }
+    
+    private func addPendingFindById(collectionName: String, id: String, options: [String:AnyObject]?, completion: (AXObject?, NSError?) -> ()) {
+        let queryParameters = queryParametersFromQueryOptions(options)
+        let key = collectionName + "?" + queryParameters.sort({ $0.0 < $1.0 }).map({ "\($0)=\($1)" }).joinWithSeparator("&")
+        var pending: AXPendingFindsById! = pendingFindsById[key]
+        if pending == nil {
+            pending = AXPendingFindsById(collectionName: collectionName, options: options)
+            pendingFindsById[key] = pending
+            let time = dispatch_time(DISPATCH_TIME_NOW, Int64(findByIdBatchWindow * Double(NSEC_PER_SEC)))
+            dispatch_after(time, dispatch_get_main_queue()) {
+                if self.pendingFindsById[key] === pending {
+                    self.flushFindsById(key)
+                }
+            }
+        }
+        if pending.completions[id] == nil {
+            pending.ids.append(id)
+            pending.completions[id] = []
+        }
+        pending.completions[id]?.append(completion)
+        if pending.ids.count >= maxFindByIdBatchSize {
+            flushFindsById(key)
+        }
+    }
+    
+    private func flushFindsById(key: String) {
+        guard let pending = pendingFindsById.removeValueForKey(key) else {
+            return
+        }
+        if pending.ids.count == 1 {
+            // identical requests for a single object are coalesced by the api client
+            for completion in pending.completions[pending.ids[0]] ?? [] {
+                let url = urlForObject(pending.collectionName, withId: pending.ids[0], queryParameters: queryParametersFromQueryOptions(pending.options))
+                loadObjects(pending.collectionName, url: url, extract: { $0.map({ [$0] }) }) {
+                    completion($0?.first, $1)
+                }
+            }
+            return
+        }
+        
+        let query = AXQuery()
+        query.logicalOperator = "or"
+        for id in pending.ids {
+            query.string("sysObjectId", equals: id)
+        }
+        var queryParameters = queryParametersFromQueryOptions(pending.options)
+        queryParameters["filter"] = query.queryString
+        let url = urlForCollection(pending.collectionName, queryParameters: queryParameters)
+        AXLog.debug("Combining \(pending.ids.count) lookups by id in \(pending.collectionName) into one query")
+        apiClient.dictionaryFromUrl(url, queue: decodeQueue) {
             dictionary, error in
-            if let properties = dictionary {
-                completion?(self.create(collectionName, properties: properties, status: .Saved), error)
-            } else {
-                completion?(nil, error)
+            var propertiesById: [String:[String:AnyObject]] = [:]
+            for properties in dictionary?["objects"] as? [[String:AnyObject]] ?? [] {
+                if let id = properties["sysObjectId"] as? String {
+                    propertiesById[id] = properties
+                }
+            }
+            for id in pending.ids {
+                for completion in pending.completions[id] ?? [] {
+                    var object: AXObject?
+                    var objectError = error
+                    if let properties = propertiesById[id] {
+                        object = self.create(pending.collectionName, properties: properties, status: .Saved)
+                    } else if error == nil {
+                        objectError = NSError(domain: "ApiClientHttpError", code: 404, userInfo: ["errorMessage": "Object \(id) not found in \(pending.collectionName)"])
+                    }
+                    dispatch_async(self.completionQueue) {
+                        completion(object, objectError)
+                    }
+                }
             }
         }
     }
@@ -220,13 +489,64 @@ public class AXObjectService {
         var queryParameters = queryParametersFromQueryOptions(options)
         queryParameters["filter"] = query.queryString
         let url = apiClient.urlFromTemplate("/objects/:collection", parameters: ["collection": collectionName], queryParameters: queryParameters)!
-        apiClient.dictionaryFromUrl(url) {
+        loadObjects(collectionName, url: url, extract: { $0?["objects"] as? [[String:AnyObject]] }) {
+            completion?($0 ?? [], $1)
+        }
+    }
+    
+    // Decoding and object creation happen on decodeQueue, and completion is called on completionQueue.
+    // With an object cache, cached objects are delivered first, and the server result only if it differs.
+    // decodeQueue is serial, so a cached result is always delivered before the server result.
+    // At launch the request waits until the cache log has been read in the background.
+    private func loadObjects(collectionName: String, url: NSURL, extract: ([String:AnyObject]?) -> [[String:AnyObject]]?, completion: ([AXObject]?, NSError?) -> ()) {
+        if let cache = objectCache {
+            cache.whenLoaded() {
+                self.loadObjects(collectionName, url: url, cache: cache, extract: extract, completion: completion)
+            }
+        } else {
+            loadObjects(collectionName, url: url, cache: nil, extract: extract, completion: completion)
+        }
+    }
+    
+    private func loadObjects(collectionName: String, url: NSURL, cache: AXObjectCache?, extract: ([String:AnyObject]?) -> [[String:AnyObject]]?, completion: ([AXObject]?, NSError?) -> ()) {
+        let cached = cache?.propertiesForQuery(url)
+        if let cachedProperties = cached {
+            dispatch_async(decodeQueue) {
+                let objects = self.createObjects(collectionName, properties: cachedProperties, status: .Saved)
+                dispatch_async(self.completionQueue) {
+                    completion(objects, nil)
+                }
+            }
+        }
+        apiClient.dictionaryFromUrl(url, queue: decodeQueue) {
             dictionary, error in
-            var objects: [AXObject] = []
-            if let properties = dictionary?["objects"] as? [[String:AnyObject]] {
-                objects = self.createObjects(collectionName, properties: properties, status: .Saved)
+            let properties = extract(dictionary)
+            guard let cache = cache else {
+                let objects = properties.map({ self.createObjects(collectionName, properties: $0, status: .Saved) })
+                dispatch_async(self.completionQueue) {
+                    completion(objects, error)
+                }
+                return
+            }
+            
+            var deliver = true
+            if let cachedProperties = cached {
+                if error != nil {
+                    AXLog.info("Using cached result after failed revalidation: \(error!.localizedDescription)")
+                }
+                deliver = error == nil && !AXObjectCache.isCurrent(cachedProperties, fresh: properties ?? [])
+            }
+            let objects = deliver ? properties.map({ self.createObjects(collectionName, properties: $0, status: .Saved) }) : nil
+            dispatch_async(dispatch_get_main_queue()) {
+                if let properties = properties where error == nil {
+                    cache.storeProperties(properties, collectionName: collectionName, forQuery: url)
+                }
+                if deliver {
+                    dispatch_async(self.completionQueue) {
+                        completion(objects, error)
+                    }
+                }
             }
-            completion?(objects, error)
         }
     }
     
@@ -272,4 +592,17 @@ public class AXObjectService {
         }
         return parameters
     }
-}
\ No newline at end of file
+}
+
+private class AXPendingFindsById {
+    
+    let collectionName: String
+    let options: [String:AnyObject]?
+    var ids: [String] = []
+    var completions: [String:[(AXObject?, NSError?) -> ()]] = [:]
+    
+    init(collectionName: String, options: [String:AnyObject]?) {
+        self.collectionName = collectionName
+        self.options = options
+    }
+}
@@ -2,9 +2,13 @@
 #import <Foundation/Foundation.h>
 
 @class AXApiClient;
+@class AXWriteQueue;
 
 @interface AXPermissionsService : NSObject
 
+// When writeQueue is set, permission changes are stored in the queue and sent from there
+@property AXWriteQueue *writeQueue;
+
 - (instancetype)initWithApiClient:(AXApiClient *)apiClient;
 
 - (void)grant:(NSArray *)grants revoke:(NSArray *)revokes objectID:(NSString *)objectID completion:(void(^)(NSError *))completion;
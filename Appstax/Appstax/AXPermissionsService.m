@@ -18,6 +18,10 @@
 }
 
 - (void)grant:(NSArray *)grants revoke:(NSArray *)revokes objectID:(NSString *)objectID completion:(void(^)(NSError *))completion {
+    if(_writeQueue != nil) {
+        [_writeQueue enqueuePermissions:grants revokes:revokes objectID:objectID localID:nil completion:completion];
+        return;
+    }
     NSURL *url = [_apiClient urlFromTemplate:@"/permissions" parameters:@{} queryParameters:@{}];
     [_apiClient postDictionary:@{@"grants":[self fillPermissions:grants withObjectID:objectID],
                                  @"revokes":[self fillPermissions:revokes withObjectID:objectID]}
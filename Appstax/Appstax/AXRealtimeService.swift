@@ -1,5 +1,6 @@
 
 import Foundation
+import UIKit
 import Starscream
 
 @objc public enum AXRealtimeServiceStatus: NSInteger {
@@ -8,20 +9,39 @@ import Starscream
     case Connected
 }
 
+@objc public enum AXRealtimeQueueOverflow: NSInteger {
+    case DropOldest
+    case DropNewest
+}
+
 class AXRealtimeService: NSObject {
     
     private var apiClient: AXApiClient
-    private var connectionCheckTimer: NSTimer?
     private var webSocket: AXWebSocketAdapter?
-    private var realtimeSessionRequested: Bool = false
     private var realtimeSessionId: String?
+    private var state: AXConnectionState = .Idle
+    private var wantsConnection = false
+    private var retryTimer: NSTimer?
+    private var heartbeatTimer: NSTimer?
+    private var pingSentAt: NSDate?
+    private var reconnectAttempts = 0
+    private var failedOpens = 0
     private var eventHub = AXEventHub()
-    private var queue: [[String:AnyObject]] = []
+    private var router = AXChannelRouter()
+    private var subscriptions: [String:AXSubscription] = [:]
+    private var queue: [AXQueuedPacket?] = []
+    private var queueHead = 0
+    private var queuedCount = 0
+    private var queuedKeys: [String:Int] = [:]
+    private var frame: [[String:AnyObject]] = []
     private var idCounter = 0
+    private let decodeQueue = dispatch_queue_create("com.appstax.realtime.decode", DISPATCH_QUEUE_SERIAL)
+    private var decodedEvents: [AXChannelEvent] = []
+    private var handledTypes = Set<String>()
     private(set) var status: AXRealtimeServiceStatus = .Disconnected {
         didSet {
             if status != oldValue {
-                eventHub.dispatch(AXEvent(type: "status"))
+                dispatch(AXEvent(type: "status"))
             }
         }
     }
@@ -37,19 +57,133 @@ class AXRealtimeService: NSObject {
     
     var webSocketFactory: ((url: NSURL) -> (AXWebSocketAdapter))?
     
+    // Reconnects wait reconnectDelay doubled for each failed attempt, up to
+    // maxReconnectDelay, and randomized by up to half to spread out clients
+    var reconnectDelay: NSTimeInterval = 0.5
+    var maxReconnectDelay: NSTimeInterval = 30
+    
+    // The connection is pinged every heartbeatInterval, and reconnected when
+    // the previous ping was not answered. Latency is the last ping round trip.
+    var heartbeatInterval: NSTimeInterval = 20
+    private(set) var latency: NSTimeInterval?
+    
+    // A new realtime session is requested when this many web sockets in a row
+    // fail to open with the current one
+    var maxFailedOpensPerSession = 2
+    
+    // Packets sent while disconnected are queued until the connection opens,
+    // and packets beyond maxQueuedPackets are dropped
+    var maxQueuedPackets = 1000
+    var queueOverflow: AXRealtimeQueueOverflow = .DropOldest
+    private(set) var droppedPacketCount = 0
+    
+    // Packets sent in the same run loop turn are written as one frame holding
+    // a JSON array. Only enable this for servers that accept batched frames.
+    var batchFrames = false
+    var maxBatchSize = 50
+    
     init(apiClient: AXApiClient) {
         self.apiClient = apiClient
         super.init()
         self.webSocketFactory = {
-            return StarscreamWrapper(url: $0, service: self)
+            [unowned self] url in
+            return StarscreamWrapper(url: url, service: self)
         }
+        let center = NSNotificationCenter.defaultCenter()
+        center.addObserver(self, selector: #selector(AXRealtimeService.applicationDidEnterBackground), name: UIApplicationDidEnterBackgroundNotification, object: nil)
+        center.addObserver(self, selector: #selector(AXRealtimeService.applicationWillEnterForeground), name: UIApplicationWillEnterForegroundNotification, object: nil)
+    }
+    
+    deinit {
+        NSNotificationCenter.defaultCenter().removeObserver(self)
+        retryTimer?.invalidate()
+        heartbeatTimer?.invalidate()
+        webSocket?.disconnect()
+    }
+    
+    // Stops reconnecting and closes the connection, until something connects again
+    func disconnect() {
+        wantsConnection = false
+        retryTimer?.invalidate()
+        retryTimer = nil
+        closeWebSocket()
+        state = .Idle
+        status = .Disconnected
     }
     
     func on(type: String, handler: (AXEvent) -> ()) {
         eventHub.on(type, handler: handler)
+        objc_sync_enter(self)
+        handledTypes.insert(type)
+        objc_sync_exit(self)
+    }
+    
+    // Channels are held weakly, and get the messages for their own name and
+    // all connection events
+    func addChannel(channel: AXChannel) {
+        router.add(channel)
+    }
+    
+    func removeChannel(name: String, id: ObjectIdentifier) {
+        router.remove(name, id: id)
+    }
+    
+    // Channels with the same name and filter share one subscription on the server,
+    // which is removed when the last of them unsubscribes. All subscriptions are
+    // sent again when the connection opens, so they survive reconnects.
+    func subscribe(channel: String, filter: String?) {
+        let key = subscriptionKey(channel, filter: filter)
+        if subscriptions[key] != nil {
+            subscriptions[key]?.count += 1
+            return
+        }
+        subscriptions[key] = AXSubscription(channel: channel, filter: filter, count: 1)
+        if isConnected() {
+            send(command: "subscribe", channel: channel, filter: filter)
+        } else {
+            connect()
+        }
+    }
+    
+    func unsubscribe(channel: String, filter: String?) {
+        let key = subscriptionKey(channel, filter: filter)
+        guard let subscription = subscriptions[key] else {
+            return
+        }
+        if subscription.count > 1 {
+            subscriptions[key]?.count -= 1
+            return
+        }
+        subscriptions[key] = nil
+        if isConnected() {
+            send(command: "unsubscribe", channel: channel, filter: subscription.filter)
+        }
+    }
+    
+    private func subscriptionKey(channel: String, filter: String?) -> String {
+        return channel + "\n" + (filter ?? "")
+    }
+    
+    private func sendSubscriptions() {
+        for subscription in subscriptions.values {
+            send(command: "subscribe", channel: subscription.channel, filter: subscription.filter)
+        }
+    }
+    
+    private func isConnected() -> Bool {
+        return state == .Open
     }
     
-    func send(command command: String, channel: String, message: AnyObject? = nil, data: AnyObject? = nil, filter: String? = nil) {
+    private func dispatch(event: AXEvent) {
+        eventHub.dispatch(event)
+        router.allChannels().forEach() {
+            $0.receive(event)
+        }
+    }
+    
+    // A packet sent with replaceQueued removes any queued packet with the same
+    // command and channel, so only the latest one is sent after reconnecting
+    func send(command command: String, channel: String, message: AnyObject? = nil, data: AnyObject? = nil, filter: String? = nil, replaceQueued: Bool = false) {
         idCounter += 1
 
         var packet: [String:AnyObject] = [:]
@@ -65,60 +199,177 @@ class AXRealtimeService: NSObject {
         if filter != nil {
             packet["filter"] = filter
         }
-        sendPacket(packet)
+        sendPacket(packet, key: replaceQueued ? command + "\n" + channel : nil)
     }
     
-    private func sendPacket(packet: [String:AnyObject]) {
-        if let ws = webSocket {
-            ws.send(packet)
+    private func sendPacket(packet: [String:AnyObject], key: String? = nil) {
+        if isConnected() {
+            write(packet)
         } else {
-            queue.append(packet)
+            enqueue(packet, key: key)
             connect()
         }
     }
     
-    private func sendQueue() {
-        while queue.count > 0 && webSocket != nil {
-            webSocket?.send(queue.removeFirst())
+    private func write(packet: [String:AnyObject]) {
+        if !batchFrames {
+            webSocket?.send(packet)
+            return
+        }
+        frame.append(packet)
+        if frame.count >= maxBatchSize {
+            writeFrame()
+        } else if frame.count == 1 {
+            dispatch_async(dispatch_get_main_queue()) {
+                self.writeFrame()
+            }
         }
     }
     
-    func connect() {
-        if !realtimeSessionRequested {
-            connectSession()
+    private func writeFrame() {
+        let packets = frame
+        frame = []
+        if packets.isEmpty {
+            return
         }
-        if connectionCheckTimer == nil {
-            connectionCheckTimer = NSTimer.scheduledTimerWithTimeInterval(2.0, target: self, selector: #selector(AXRealtimeService.checkConnection), userInfo: nil, repeats: true)
+        guard let ws = webSocket else {
+            packets.forEach() { enqueue($0, key: nil) }
+            return
+        }
+        if packets.count == 1 {
+            ws.send(packets[0])
+        } else {
+            ws.send(packets)
         }
     }
     
-    func checkConnection() {
-        if webSocket == nil || status == .Disconnected {
-            status = .Connecting
-            connectWebSocket()
+    private func enqueue(packet: [String:AnyObject], key: String?) {
+        if let key = key, index = queuedKeys[key] {
+            queue[index] = nil
+            queuedCount -= 1
+        } else if queuedCount >= maxQueuedPackets {
+            droppedPacketCount += 1
+            if queueOverflow == .DropNewest {
+                AXLog.info("Realtime queue is full, dropping newest packet")
+                return
+            }
+            AXLog.info("Realtime queue is full, dropping oldest packet")
+            dropOldestPacket()
+        }
+        queue.append(AXQueuedPacket(packet: packet, key: key))
+        queuedCount += 1
+        if let key = key {
+            queuedKeys[key] = queue.count - 1
         }
+        compactQueue()
     }
     
-    func connectSession() {
+    private func dropOldestPacket() {
+        while queueHead < queue.count {
+            let queued = queue[queueHead]
+            queue[queueHead] = nil
+            queueHead += 1
+            if let queued = queued {
+                if let key = queued.key {
+                    queuedKeys[key] = nil
+                }
+                queuedCount -= 1
+                break
+            }
+        }
+    }
+    
+    // Dropped and replaced packets leave holes, which are removed once they
+    // outnumber the queued packets, so the queue stays within twice its limit
+    private func compactQueue() {
+        if queue.count <= queuedCount * 2 + 16 {
+            return
+        }
+        queue = queue[queueHead..<queue.count].filter() { $0 != nil }
+        queueHead = 0
+        queuedKeys = [:]
+        for (index, queued) in queue.enumerate() {
+            if let key = queued?.key {
+                queuedKeys[key] = index
+            }
+        }
+    }
+    
+    private func sendQueue() {
+        let packets = queue[queueHead..<queue.count].flatMap() { $0?.packet }
+        queue = []
+        queueHead = 0
+        queuedCount = 0
+        queuedKeys = [:]
+        packets.forEach() { write($0) }
+    }
+    
+    func connect() {
+        wantsConnection = true
+        if state == .Idle {
+            openConnection()
+        }
+    }
+    
+    private func openConnection() {
+        retryTimer?.invalidate()
+        retryTimer = nil
         status = .Connecting
-        realtimeSessionRequested = true
+        if realtimeSessionId == nil {
+            requestSession()
+        } else {
+            openWebSocket()
+        }
+    }
+    
+    private func requestSession() {
+        state = .RequestingSession
         let url = apiClient.urlFromTemplate("/messaging/realtime/sessions", parameters: [:])!
         apiClient.postDictionary([:], toUrl: url) {
             dictionary, error in
-            if error == nil {
-                self.realtimeSessionId = dictionary?["realtimeSessionId"] as? String
-                self.connectionCheckTimer?.fire()
+            if self.state != .RequestingSession {
+                return
+            }
+            if let sessionId = dictionary?["realtimeSessionId"] as? String where error == nil {
+                self.realtimeSessionId = sessionId
+                self.failedOpens = 0
+                self.openWebSocket()
             } else {
-                self.eventHub.dispatch(AXEvent(type: "error"))
+                self.dispatch(AXEvent(type: "error"))
+                self.retryLater()
             }
         }
     }
     
-    func connectWebSocket() {
-        if realtimeSessionId != nil {
-            if let url = webSocketUrl() {
-                webSocket = webSocketFactory?(url: url)
-            }
+    private func openWebSocket() {
+        state = .Opening
+        if let url = webSocketUrl() {
+            webSocket = webSocketFactory?(url: url)
+        } else {
+            retryLater()
+        }
+    }
+    
+    private func closeWebSocket() {
+        stopHeartbeat()
+        webSocket?.disconnect()
+        webSocket = nil
+    }
+    
+    private func retryLater() {
+        let backoff = min(maxReconnectDelay, reconnectDelay * pow(2, Double(reconnectAttempts)))
+        let jitter = 0.5 + Double(arc4random_uniform(1000)) / 2000
+        reconnectAttempts += 1
+        state = .WaitingToRetry
+        status = .Connecting
+        retryTimer?.invalidate()
+        let target = AXTimerTarget(self) { $0.retry() }
+        retryTimer = NSTimer.scheduledTimerWithTimeInterval(backoff * jitter, target: target, selector: #selector(AXTimerTarget.fire), userInfo: nil, repeats: false)
+    }
+    
+    func retry() {
+        if state == .WaitingToRetry {
+            openConnection()
         }
     }
     
@@ -131,54 +382,354 @@ class AXRealtimeService: NSObject {
     }
     
     func webSocketDidConnect() {
+        state = .Open
+        reconnectAttempts = 0
+        failedOpens = 0
         status = .Connected
-        eventHub.dispatch(AXEvent(type: "open"))
+        dispatch(AXEvent(type: "open"))
+        sendSubscriptions()
         sendQueue()
+        startHeartbeat()
     }
     
+    // Servers reject the upgrade request with a 4xx status when the session has expired
     func webSocketDidDisconnect(error: NSError?) {
+        let wasOpening = state == .Opening
         webSocket = nil
-        eventHub.dispatch(AXEvent(type: "error"))
+        stopHeartbeat()
+        if wasOpening {
+            failedOpens += 1
+            let rejected = error.map({ 400..<500 ~= $0.code }) ?? false
+            if rejected || failedOpens >= maxFailedOpensPerSession {
+                realtimeSessionId = nil
+            }
+        }
+        dispatch(AXEvent(type: "error"))
+        if wasOpening || state == .Open {
+            retryLater()
+        }
+    }
+    
+    private func startHeartbeat() {
+        stopHeartbeat()
+        let target = AXTimerTarget(self) { $0.heartbeat() }
+        heartbeatTimer = NSTimer.scheduledTimerWithTimeInterval(heartbeatInterval, target: target, selector: #selector(AXTimerTarget.fire), userInfo: nil, repeats: true)
+    }
+    
+    private func stopHeartbeat() {
+        heartbeatTimer?.invalidate()
+        heartbeatTimer = nil
+        pingSentAt = nil
+    }
+    
+    // The socket itself can take minutes to notice that the network is gone
+    func heartbeat() {
+        if pingSentAt != nil {
+            AXLog.info("Realtime connection did not answer ping, reconnecting")
+            closeWebSocket()
+            webSocketDidDisconnect(nil)
+            return
+        }
+        pingSentAt = NSDate()
+        webSocket?.ping()
+    }
+    
+    func webSocketDidReceivePong() {
+        if let sentAt = pingSentAt {
+            latency = -sentAt.timeIntervalSinceNow
+            pingSentAt = nil
+        }
+    }
+    
+    // The connection is closed in the background and opened again, without
+    // waiting for backoff, when the app returns to the foreground
+    func applicationDidEnterBackground() {
+        if !wantsConnection {
+            return
+        }
+        retryTimer?.invalidate()
+        retryTimer = nil
+        closeWebSocket()
+        state = .Suspended
+        status = .Disconnected
+    }
+    
+    func applicationWillEnterForeground() {
+        if state == .Suspended {
+            reconnectAttempts = 0
+            openConnection()
+        }
     }
     
     func webSocketDidReceiveMessage(dict: [String:AnyObject]) {
-        eventHub.dispatch(AXChannelEvent(dict))
+        deliver(AXChannelEvent(dict))
+    }
+    
+    // Frames are parsed on the decode queue, and events with their objects are
+    // only created for messages that a channel or handler is listening for.
+    // Events decoded in the meantime are delivered together on the next turn
+    // of the main run loop.
+    func webSocketDidReceiveText(text: String) {
+        dispatch_async(decodeQueue) {
+            let events = self.deserialize(text).filter(self.isRouted).map() {
+                AXChannelEvent($0)
+            }
+            if events.isEmpty {
+                return
+            }
+            objc_sync_enter(self)
+            let scheduled = !self.decodedEvents.isEmpty
+            self.decodedEvents += events
+            objc_sync_exit(self)
+            if !scheduled {
+                dispatch_async(dispatch_get_main_queue()) {
+                    self.deliverDecodedEvents()
+                }
+            }
+        }
+    }
+    
+    private func deliverDecodedEvents() {
+        objc_sync_enter(self)
+        let events = decodedEvents
+        decodedEvents = []
+        objc_sync_exit(self)
+        events.forEach() {
+            deliver($0)
+        }
+    }
+    
+    private func deliver(event: AXChannelEvent) {
+        eventHub.dispatch(event)
+        router.channelsForName(event.channel).forEach() {
+            $0.receive(event)
+        }
+    }
+    
+    private func isRouted(dict: [String:AnyObject]) -> Bool {
+        let type = dict["event"] as? String ?? ""
+        objc_sync_enter(self)
+        let handled = handledTypes.contains(type) || handledTypes.contains("*")
+        objc_sync_exit(self)
+        return handled || router.hasChannels(dict["channel"] as? String ?? "")
+    }
+    
+    // Frames hold a single message, or an array of messages from servers that batch them
+    private func deserialize(text: String) -> [[String:AnyObject]] {
+        let data = text.dataUsingEncoding(NSUTF8StringEncoding) ?? NSData()
+        let json = try? NSJSONSerialization.JSONObjectWithData(data, options: NSJSONReadingOptions(rawValue: 0))
+        if let dict = json as? [String:AnyObject] {
+            return [dict]
+        }
+        return json as? [[String:AnyObject]] ?? []
+    }
+
+}
+
+// Finds the channels for a message by exact name, and channels with wildcard
+// names ("objects/*") by walking a trie of their prefixes, so the cost depends
+// on the length of the name rather than the number of channels. Channels are
+// added and removed on the main thread, and hasChannels is also called from
+// the decode queue, so those three are locked.
+private class AXChannelRouter {
+    
+    private var exact: [String:[ObjectIdentifier:AXWeakChannel]] = [:]
+    private var wildcards = AXChannelTrieNode()
+    
+    func add(channel: AXChannel) {
+        objc_sync_enter(self)
+        let id = ObjectIdentifier(channel)
+        if let prefix = wildcardPrefix(channel.name) {
+            var node = wildcards
+            for character in prefix.characters {
+                let next = node.children[character] ?? AXChannelTrieNode()
+                node.children[character] = next
+                node = next
+            }
+            node.channels[id] = AXWeakChannel(channel: channel)
+        } else {
+            var channels = exact[channel.name] ?? [:]
+            channels[id] = AXWeakChannel(channel: channel)
+            exact[channel.name] = channels
+        }
+        objc_sync_exit(self)
+    }
+    
+    func remove(name: String, id: ObjectIdentifier) {
+        objc_sync_enter(self)
+        if let prefix = wildcardPrefix(name) {
+            remove(id, node: wildcards, path: ArraySlice(prefix.characters))
+        } else if var channels = exact[name] {
+            channels[id] = nil
+            exact[name] = channels.isEmpty ? nil : channels
+        }
+        objc_sync_exit(self)
+    }
+    
+    // Removes nodes left without channels on the way back up
+    private func remove(id: ObjectIdentifier, node: AXChannelTrieNode, path: ArraySlice<Character>) {
+        guard let character = path.first else {
+            node.channels[id] = nil
+            return
+        }
+        if let next = node.children[character] {
+            remove(id, node: next, path: path.dropFirst())
+            if next.channels.isEmpty && next.children.isEmpty {
+                node.children[character] = nil
+            }
+        }
+    }
+    
+    func channelsForName(name: String) -> [AXChannel] {
+        var result = (exact[name] ?? [:]).values.flatMap({ $0.channel })
+        var node = wildcards
+        result += node.channels.values.flatMap({ $0.channel })
+        for character in name.characters {
+            guard let next = node.children[character] else {
+                break
+            }
+            result += next.channels.values.flatMap({ $0.channel })
+            node = next
+        }
+        return result
+    }
+    
+    func hasChannels(name: String) -> Bool {
+        objc_sync_enter(self)
+        var found = exact[name] != nil || !wildcards.channels.isEmpty
+        var node = wildcards
+        for character in name.characters {
+            guard let next = node.children[character] where !found else {
+                break
+            }
+            found = !next.channels.isEmpty
+            node = next
+        }
+        objc_sync_exit(self)
+        return found
+    }
+    
+    func allChannels() -> [AXChannel] {
+        var result = exact.values.flatMap({ $0.values.flatMap({ $0.channel }) })
+        var pending = [wildcards]
+        while let node = pending.popLast() {
+            result += node.channels.values.flatMap({ $0.channel })
+            pending += node.children.values
+        }
+        return result
     }
     
+    private func wildcardPrefix(name: String) -> String? {
+        if name.hasSuffix("*") {
+            return String(name.characters.dropLast())
+        }
+        return nil
+    }
+
+}
+
+// Timers retain their target, so they call the service through this to let it be released
+private class AXTimerTarget: NSObject {
+    
+    private weak var service: AXRealtimeService?
+    private let action: (AXRealtimeService) -> ()
+    
+    init(_ service: AXRealtimeService, action: (AXRealtimeService) -> ()) {
+        self.service = service
+        self.action = action
+    }
+    
+    @objc func fire() {
+        if let service = service {
+            action(service)
+        }
+    }
+}
+
+private enum AXConnectionState {
+    case Idle
+    case RequestingSession
+    case Opening
+    case Open
+    case WaitingToRetry
+    case Suspended
+}
+
+private struct AXQueuedPacket {
+    let packet: [String:AnyObject]
+    let key: String?
+}
+
+private struct AXSubscription {
+    let channel: String
+    let filter: String?
+    var count: Int
+}
+
+private class AXChannelTrieNode {
+    var children: [Character:AXChannelTrieNode] = [:]
+    var channels: [ObjectIdentifier:AXWeakChannel] = [:]
+}
+
+private struct AXWeakChannel {
+    weak var channel: AXChannel?
 }
 
 protocol AXWebSocketAdapter {
     
     func send(message:AnyObject)
+    func ping()
+    func disconnect()
 }
 
-class StarscreamWrapper: AXWebSocketAdapter, WebSocketDelegate {
+extension AXWebSocketAdapter {
+    
+    func ping() {}
+    func disconnect() {}
+}
+
+class StarscreamWrapper: AXWebSocketAdapter, WebSocketDelegate, WebSocketPongDelegate {
     
     private var webSocket: WebSocket
-    private var realtimeService: AXRealtimeService
+    private weak var realtimeService: AXRealtimeService?
     
     init(url: NSURL, service: AXRealtimeService) {
         realtimeService = service
         webSocket = WebSocket(url: url)
         webSocket.delegate = self
+        webSocket.pongDelegate = self
         webSocket.connect()
     }
     
     func send(message:AnyObject) {
         if let str = message as? String {
             webSocket.writeString(str)
-        } else if let dict = message as? [String:AnyObject] {
-            let str = serializeDictionary(dict)
-            webSocket.writeString(str)
+        } else if message is [String:AnyObject] || message is [[String:AnyObject]] {
+            webSocket.writeString(serialize(message))
         }
     }
     
+    func ping() {
+        webSocket.writePing(NSData())
+    }
+    
+    // No more callbacks are delivered once the service has closed the socket
+    func disconnect() {
+        webSocket.delegate = nil
+        webSocket.pongDelegate = nil
+        webSocket.disconnect()
+    }
+    
     func websocketDidConnect(socket: WebSocket) {
-        realtimeService.webSocketDidConnect()
+        realtimeService?.webSocketDidConnect()
     }
     
     func websocketDidDisconnect(socket: WebSocket, error: NSError?) {
-        realtimeService.webSocketDidDisconnect(error)
+        realtimeService?.webSocketDidDisconnect(error)
+    }
+    
+    func websocketDidReceivePong(socket: WebSocket) {
+        realtimeService?.webSocketDidReceivePong()
     }
     
     func websocketDidReceiveData(socket: WebSocket, data: NSData) {
@@ -186,22 +737,12 @@ class StarscreamWrapper: AXWebSocketAdapter, WebSocketDelegate {
     }
     
     func websocketDidReceiveMessage(socket: WebSocket, text: String) {
-        if let dict = deserializeDictionary(text) {
-            realtimeService.webSocketDidReceiveMessage(dict)
-        }
-    }
-    
-    private func deserializeDictionary(text: String) -> [String:AnyObject]? {
-        let data = text.dataUsingEncoding(NSUTF8StringEncoding) ?? NSData()
-        if let dict = try? NSJSONSerialization.JSONObjectWithData(data, options: NSJSONReadingOptions(rawValue: 0)) as? [String:AnyObject] {
-            return dict
-        }
-        return nil
+        realtimeService?.webSocketDidReceiveText(text)
     }
     
-    private func serializeDictionary(dictionary: [String:AnyObject]?) -> String {
+    private func serialize(object: AnyObject) -> String {
         var result = "{}"
-        if let data = try? NSJSONSerialization.dataWithJSONObject(dictionary!, options: NSJSONWritingOptions(rawValue: 0)) {
+        if let data = try? NSJSONSerialization.dataWithJSONObject(object, options: NSJSONWritingOptions(rawValue: 0)) {
             if let str = NSString(data: data, encoding: NSUTF8StringEncoding) as? String {
                 result = str
             }
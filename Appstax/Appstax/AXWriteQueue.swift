@@ -0,0 +1,332 @@
+
+import Foundation
+
+/// Durable queue of object saves, removes and permission changes, used by
+/// AXObjectService and AXPermissionsService to keep working while offline.
+///
+/// Writes are stored in a file and sent to the server one at a time, in order.
+/// A save is merged into an earlier save of the same object that has not been
+/// sent yet, and a remove drops the unsent writes for the object before it.
+/// When a write fails with a connectivity error or a 408, 429 or 502-504
+/// response the queue goes offline: the write stays at the head of the queue, completion handlers of
+/// queued writes are called without error, and the queue tries again after
+/// flushRetryInterval, doubling up to maxFlushRetryInterval. Call flush() to try
+/// again right away, for example when reachability changes.
+///
+/// A write that is rejected by the server is dropped and reported to
+/// conflictHandler with the stored write record. Writes are sent with the
+/// current session, so Appstax calls removeAll() when the user changes. All
+/// methods must be called on the main queue.
+@objc public class AXWriteQueue: NSObject {
+    
+    /// Called with the write record and the error when the server rejects a queued write
+    public var conflictHandler: (([String:AnyObject], NSError) -> ())?
+    
+    public var flushRetryInterval: NSTimeInterval = 5
+    public var maxFlushRetryInterval: NSTimeInterval = 60
+    
+    public private(set) var isOffline = false
+    
+    private let apiClient: AXApiClient
+    private let path: String
+    private let ioQueue = dispatch_queue_create("com.appstax.writequeue", DISPATCH_QUEUE_SERIAL)
+    private let liveObjects = NSMapTable.strongToWeakObjectsMapTable()
+    private var writes: [AXQueuedWrite] = []
+    private var flushing = false
+    private var retryDelay: NSTimeInterval = 0
+    private var retryScheduled = false
+    private var loaded = false
+    
+    public convenience init(appKey: String, apiClient: AXApiClient) {
+        let support = NSSearchPathForDirectoriesInDomains(.ApplicationSupportDirectory, .UserDomainMask, true).first ?? NSTemporaryDirectory()
+        let directory = (support as NSString).stringByAppendingPathComponent("Appstax")
+        _ = try? NSFileManager.defaultManager().createDirectoryAtPath(directory, withIntermediateDirectories: true, attributes: nil)
+        self.init(path: (directory as NSString).stringByAppendingPathComponent("WriteQueue-\(appKey).json"), apiClient: apiClient)
+    }
+    
+    public init(path: String, apiClient: AXApiClient) {
+        self.path = path
+        self.apiClient = apiClient
+        super.init()
+    }
+    
+    public var pendingWriteCount: Int {
+        get {
+            load()
+            return writes.count
+        }
+    }
+    
+    internal func hasPendingWrites(object: AXObject) -> Bool {
+        load()
+        return writes.contains({ $0.isFor(object.objectID, localID: object.internalID) })
+    }
+    
+    internal func enqueueSave(object: AXObject, properties: [String:AnyObject], completion: (NSError?) -> ()) {
+        load()
+        liveObjects.setObject(object, forKey: object.internalID)
+        let objectID = object.objectID
+        if let write = writes.filter({ !$0.inFlight && $0.isFor(objectID, localID: object.internalID) }).last where write.type == "save" {
+            write.mergeProperties(properties)
+            enqueued(write, completion: completion)
+            return
+        }
+        var record: [String:AnyObject] = ["type": "save", "collection": object.collectionName, "localId": object.internalID, "properties": properties]
+        if let objectID = objectID {
+            record["objectId"] = objectID
+        }
+        enqueued(AXQueuedWrite(record: record), completion: completion)
+    }
+    
+    internal func enqueueRemove(object: AXObject, completion: (NSError?) -> ()) {
+        load()
+        let objectID = object.objectID
+        writes = writes.filter({ $0.inFlight || !$0.isFor(objectID, localID: object.internalID) })
+        if objectID == nil && !writes.contains({ $0.isFor(nil, localID: object.internalID) }) {
+            persist()
+            completion(nil)
+            return
+        }
+        var record: [String:AnyObject] = ["type": "remove", "collection": object.collectionName, "localId": object.internalID]
+        if let objectID = objectID {
+            record["objectId"] = objectID
+        }
+        enqueued(AXQueuedWrite(record: record), completion: completion)
+    }
+    
+    /// Queues a permission change. localID identifies an object created while
+    /// offline, whose objectID is filled in when its create has been sent.
+    public func enqueuePermissions(grants: [[String:AnyObject]], revokes: [[String:AnyObject]], objectID: String?, localID: String?, completion: ((NSError?) -> ())?) {
+        load()
+        var record: [String:AnyObject] = ["type": "permissions", "grants": grants, "revokes": revokes]
+        if let objectID = objectID {
+            record["objectId"] = objectID
+        }
+        if let localID = localID {
+            record["localId"] = localID
+        }
+        enqueued(AXQueuedWrite(record: record), completion: { completion?($0) })
+    }
+    
+    /// Sends queued writes now, unless a flush is already in progress
+    public func flush() {
+        load()
+        if flushing || writes.isEmpty {
+            return
+        }
+        flushing = true
+        let write = writes[0]
+        write.inFlight = true
+        send(write.record) {
+            dictionary, error in
+            self.flushing = false
+            write.inFlight = false
+            guard let index = self.writes.indexOf({ $0 === write }) else {
+                write.complete(error)
+                self.flush()
+                return
+            }
+            if let error = error where AXWriteQueue.isOfflineError(error) {
+                self.goOffline(error)
+                return
+            }
+            self.isOffline = false
+            self.retryDelay = 0
+            self.writes.removeAtIndex(index)
+            if let error = error {
+                AXLog.warn("Queued \(write.type) was rejected: \(error.localizedDescription)")
+                self.conflictHandler?(write.record, error)
+            } else {
+                self.didSend(write, response: dictionary)
+            }
+            self.persist()
+            write.complete(error)
+            self.flush()
+        }
+    }
+    
+    /// Drops all queued writes without sending them
+    public func removeAll() {
+        load()
+        writes = []
+        persist()
+    }
+    
+    internal func waitUntilWritten() {
+        dispatch_sync(ioQueue) {}
+    }
+    
+    private func enqueued(write: AXQueuedWrite, completion: (NSError?) -> ()) {
+        if !writes.contains({ $0 === write }) {
+            writes.append(write)
+        }
+        persist()
+        if isOffline {
+            completion(nil)
+        } else {
+            write.completions.append(completion)
+            flush()
+        }
+    }
+    
+    private func goOffline(error: NSError) {
+        if !isOffline {
+            AXLog.info("Offline, keeping \(writes.count) writes queued: \(error.localizedDescription)")
+        }
+        isOffline = true
+        for write in writes {
+            write.complete(nil)
+        }
+        retryDelay = retryDelay == 0 ? flushRetryInterval : min(retryDelay * 2, maxFlushRetryInterval)
+        if retryScheduled {
+            return
+        }
+        retryScheduled = true
+        let time = dispatch_time(DISPATCH_TIME_NOW, Int64(retryDelay * Double(NSEC_PER_SEC)))
+        dispatch_after(time, dispatch_get_main_queue()) {
+            self.retryScheduled = false
+            self.flush()
+        }
+    }
+    
+    private func didSend(write: AXQueuedWrite, response: [String:AnyObject]?) {
+        let localID = write.record["localId"] as? String
+        if write.type == "save" && write.record["objectId"] == nil, let id = response?["sysObjectId"] as? String {
+            for other in writes where other.isFor(nil, localID: localID) {
+                other.record["objectId"] = id
+            }
+            if let localID = localID, object = liveObjects.objectForKey(localID) as? AXObject {
+                object.objectID = id
+            }
+        }
+        if let localID = localID, object = liveObjects.objectForKey(localID) as? AXObject
+            where object.status == .Modified && !hasPendingWrites(object) {
+            object.status = .Saved
+        }
+    }
+    
+    private func send(record: [String:AnyObject], completion: ([String:AnyObject]?, NSError?) -> ()) {
+        let type = record["type"] as? String ?? ""
+        let collection = record["collection"] as? String ?? ""
+        let objectID = record["objectId"] as? String
+        if type == "save" && objectID == nil {
+            let url = apiClient.urlFromTemplate("objects/:collection", parameters: ["collection": collection])!
+            apiClient.postDictionary(record["properties"] as? [String:AnyObject] ?? [:], toUrl: url, completion: completion)
+            return
+        }
+        guard let id = objectID else {
+            completion(nil, NSError(domain: "AXObjectError", code: 0, userInfo: [NSLocalizedDescriptionKey: "Queued \(type) has no object id since the object was never created"]))
+            return
+        }
+        switch type {
+        case "save":
+            let url = apiClient.urlFromTemplate("objects/:collection/:id", parameters: ["collection": collection, "id": id])!
+            apiClient.putDictionary(record["properties"] as? [String:AnyObject] ?? [:], toUrl: url, completion: completion)
+        case "remove":
+            let url = apiClient.urlFromTemplate("objects/:collection/:id", parameters: ["collection": collection, "id": id])!
+            apiClient.deleteUrl(url) { completion(nil, $0) }
+        default:
+            let fill: (AnyObject?) -> [[String:AnyObject]] = {
+                ($0 as? [[String:AnyObject]] ?? []).map({
+                    var permission = $0
+                    permission["sysObjectId"] = id
+                    return permission
+                })
+            }
+            let url = apiClient.urlFromTemplate("/permissions", parameters: [:])!
+            apiClient.postDictionary(["grants": fill(record["grants"]), "revokes": fill(record["revokes"])], toUrl: url, completion: completion)
+        }
+    }
+    
+    private static func isOfflineError(error: NSError) -> Bool {
+        if error.domain == NSURLErrorDomain {
+            return [NSURLErrorTimedOut, NSURLErrorCannotFindHost, NSURLErrorCannotConnectToHost, NSURLErrorNetworkConnectionLost,
+                    NSURLErrorDNSLookupFailed, NSURLErrorNotConnectedToInternet, NSURLErrorInternationalRoamingOff,
+                    NSURLErrorCallIsActive, NSURLErrorDataNotAllowed, NSURLErrorSecureConnectionFailed].contains(error.code)
+        }
+        return error.domain == "ApiClientHttpError" && [408, 429, 502, 503, 504].contains(error.code)
+    }
+    
+    // MARK: Storage
+    
+    private func load() {
+        if loaded {
+            return
+        }
+        loaded = true
+        guard let data = NSData(contentsOfFile: path),
+            records = (try? NSJSONSerialization.JSONObjectWithData(data, options: [])) as? [[String:AnyObject]] else {
+            return
+        }
+        writes = records.map({ AXQueuedWrite(record: $0) })
+        AXLog.debug("Loaded \(writes.count) queued writes")
+    }
+    
+    private func persist() {
+        let path = self.path
+        guard let data = try? NSJSONSerialization.dataWithJSONObject(writes.map({ $0.record }), options: []) else {
+            AXLog.warn("Unable to serialize queued writes")
+            return
+        }
+        dispatch_async(ioQueue) {
+            if !data.writeToFile(path, atomically: true) {
+                AXLog.warn("Unable to store queued writes at \(path)")
+            }
+        }
+    }
+
+}
+
+private class AXQueuedWrite {
+    
+    var record: [String:AnyObject]
+    var completions: [(NSError?) -> ()] = []
+    var inFlight = false
+    
+    init(record: [String:AnyObject]) {
+        self.record = record
+    }
+    
+    var type: String {
+        return record["type"] as? String ?? ""
+    }
+    
+    func isFor(objectID: String?, localID: String?) -> Bool {
+        if let localID = localID where record["localId"] as? String == localID {
+            return true
+        }
+        if let objectID = objectID where record["objectId"] as? String == objectID {
+            return true
+        }
+        return false
+    }
+    
+    // Later values win, except relation changes which are combined
+    func mergeProperties(properties: [String:AnyObject]) {
+        var merged = record["properties"] as? [String:AnyObject] ?? [:]
+        for (key, value) in properties {
+            if let earlier = merged[key]?["sysRelationChanges"] as? [String:[String]],
+                later = value["sysRelationChanges"] as? [String:[String]] {
+                let additions = later["additions"] ?? []
+                let removals = later["removals"] ?? []
+                let changes: [String:[String]] = [
+                    "additions": (earlier["additions"] ?? []).filter({ !removals.contains($0) }) + additions,
+                    "removals": (earlier["removals"] ?? []).filter({ !additions.contains($0) }) + removals
+                ]
+                merged[key] = ["sysRelationChanges": changes]
+            } else {
+                merged[key] = value
+            }
+        }
+        record["properties"] = merged
+    }
+    
+    func complete(error: NSError?) {
+        let completions = self.completions
+        self.completions = []
+        for completion in completions {
+            completion(error)
+        }
+    }
+
+}
@@ -12,5 +12,7 @@ FOUNDATION_EXPORT const unsigned char AppstaxVersionString[];
 
 // TODO: Make internal
 #import "AXFileService.h"
+#import "AXImageCache.h"
+#import "AXFileDataCache.h"
 #import "AXKeychain.h"
 #import "AXPermissionsService.h"
@@ -19,6 +19,39 @@ import Foundation
         Appstax.defaultContext.setupServicesWithAppKey(appKey, baseUrl: baseUrl)
     }
     
+    public static func setObjectCacheEnabled(enabled: Bool) {
+        let context = Appstax.defaultContext
+        context.objectService.objectCache = enabled ? AXObjectCache(appKey: context.appKey) : nil
+    }
+    
+    /// Stores object saves, removes and permission changes in a durable queue
+    /// that is sent in order when the server can be reached
+    public static func setOfflineWritesEnabled(enabled: Bool) {
+        let context = Appstax.defaultContext
+        let writeQueue = enabled ? AXWriteQueue(appKey: context.appKey, apiClient: context.apiClient) : nil
+        context.objectService.writeQueue = writeQueue
+        context.permissionsService.writeQueue = writeQueue
+        writeQueue?.flush()
+    }
+    
+    /// Keeps at most limit realtime messages while disconnected. When the limit is
+    /// reached the oldest or newest message is dropped and counted in realtimeDroppedMessageCount
+    public static func setRealtimeQueueLimit(limit: Int, overflow: AXRealtimeQueueOverflow) {
+        let realtimeService = Appstax.defaultContext.realtimeService
+        realtimeService.maxQueuedPackets = limit
+        realtimeService.queueOverflow = overflow
+    }
+    
+    public static var realtimeDroppedMessageCount: Int {
+        return Appstax.defaultContext.realtimeService.droppedPacketCount
+    }
+    
+    /// Sends realtime messages from the same run loop turn in one frame.
+    /// Only enable this for servers that accept batched frames.
+    public static func setRealtimeBatchingEnabled(enabled: Bool) {
+        Appstax.defaultContext.realtimeService.batchFrames = enabled
+    }
+    
     public static func setLogLevel(levelName: String) {
         if let level = AXLog.levelByName(levelName) {
             AXLog.minLevel = level
@@ -37,10 +70,24 @@ import Foundation
         self.userService = AXUserService(apiClient: apiClient)
         self.permissionsService = AXPermissionsService(apiClient: apiClient)
         self.fileService = AXFileService(apiClient: apiClient)
+        self.realtimeService?.disconnect()
         self.realtimeService = AXRealtimeService(apiClient: apiClient)
+        setupUserChangeHandlers()
         AXLog.info("Initialized Appstax with app key \(appKey) and base url \(apiClient.baseUrl)")
     }
     
+    // Cached objects and queued writes belong to the session that made them,
+    // so they are dropped when the user changes
+    private func setupUserChangeHandlers() {
+        let objectService = self.objectService
+        for type in ["login", "signup", "logout"] {
+            userService.on(type) { _ in
+                objectService.objectCache?.removeAll()
+                objectService.writeQueue?.removeAll()
+            }
+        }
+    }
+    
     public static func frameworkBundle() -> NSBundle! {
         struct Static {
             static var onceToken: dispatch_once_t = 0
@@ -1,6 +1,8 @@
 
+#import "AXCompression.h"
 #import "AXFile.h"
 #import "AXFileService.h"
+#import "AXFileDataCache.h"
 #import "AXQuery.h"
 #import "AXPermissionsService.h"
 #import "AXKeychain.h"
@@ -8,4 +10,17 @@
 
 @interface AXFile ()
 - (void)setData:(NSData *)data;
+- (NSData *)evictData;
+- (void)setBytesUploaded:(unsigned long long)bytesUploaded totalBytes:(unsigned long long)totalBytes;
+@end
+
+@interface AXFileService ()
+- (NSURL *)imageUrlForFile:(AXFile *)file size:(CGSize)size crop:(BOOL)crop;
+@end
+
+@interface AXFileDataCache ()
+- (NSString *)addData:(NSData *)data forFile:(AXFile *)file key:(NSString *)key;
+- (void)touchKey:(NSString *)key;
+- (NSData *)reloadDataForKey:(NSString *)key;
+- (void)removeKey:(NSString *)key;
 @end
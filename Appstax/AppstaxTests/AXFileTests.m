@@ -21,6 +21,8 @@
     [Appstax setAppKey:@"test-api-key" baseUrl:@"http://localhost:3000/"];
     [Appstax setLogLevel:@"trace"];
     _apiClient = [[Appstax defaultContext] apiClient];
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:@"AppstaxChunkedUploads"];
+    [[[Appstax defaultContext] fileService] setMaxConcurrentDownloads:4];
 }
 
 - (void)tearDown {
@@ -346,6 +348,8 @@
 - (void)testShouldCreateAndSaveFileFromPathWithoutKeepingDataIntoMemory {
     __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
     __block NSData *filePutBody;
+    __block NSData *filePutBodyInMemory;
+    __block NSDictionary *filePutHeaders;
     
     [AXStubs method:@"PUT"
             urlPath:@"/objects/profiles/id1234"
@@ -357,7 +361,10 @@
     [AXStubs method:@"PUT"
             urlPath:@"/files/profiles/id1234/background/clouds.jpg"
          responding:^OHHTTPStubsResponse *(NSURLRequest *request) {
-             filePutBody = [NSURLProtocol propertyForKey:@"HTTPBody" inRequest:request];
+             filePutHeaders = [NSDictionary dictionaryWithDictionary:request.allHTTPHeaderFields];
+             filePutBodyInMemory = [NSURLProtocol propertyForKey:@"HTTPBody" inRequest:request];
+             NSString *bodyPath = [NSURLProtocol propertyForKey:@"HTTPBodyFile" inRequest:request];
+             filePutBody = [NSData dataWithContentsOfFile:bodyPath];
              return [OHHTTPStubsResponse responseWithJSONObject:@{}
                                                      statusCode:200 headers:nil];
          }];
@@ -376,12 +383,144 @@
         //unsigned long memoryAfter = [self memoryInUse];
         XCTAssertEqualObjects(file.dataPath, path);
         XCTAssertNil(file.data);
+        XCTAssertNil(filePutBodyInMemory);
         XCTAssertGreaterThan(filePutBody.length, [NSData dataWithContentsOfFile:path].length);
+        AXAssertContains(filePutHeaders[@"Content-Type"], @"multipart/form-data; boundary=");
+        NSString *bodyString = [[NSString alloc] initWithData:filePutBody encoding:NSISOLatin1StringEncoding];
+        AXAssertContains(bodyString, @"Content-Disposition: form-data; name=\"file\"; filename=\"clouds.jpg\"");
+        AXAssertContains(bodyString, @"Content-Type: image/jpeg");
+        XCTAssertNotEqual([filePutBody rangeOfData:[NSData dataWithContentsOfFile:path] options:0 range:NSMakeRange(0, filePutBody.length)].location, NSNotFound);
         // TODO: Find way to check that data is not retained
         // XCTAssertLessThan(memoryAfter, memoryBefore + 10000);
     }];
 }
 
+- (void)testShouldReportErrorWhenFileForStreamedUploadCannotBeRead {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block BOOL fileRequested = NO;
+    __block NSError *saveError;
+    
+    [AXStubs method:@"PUT" urlPath:@"/objects/profiles/id1234" response:@{} statusCode:200];
+    [AXStubs method:@"PUT"
+            urlPath:@"/files/profiles/id1234/background/missing.jpg"
+         responding:^OHHTTPStubsResponse *(NSURLRequest *request) {
+             fileRequested = YES;
+             return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:200 headers:nil];
+         }];
+    
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"missing.jpg"];
+    AXFile *file = [AXFile fileWithPath:path];
+    AXObject *profile = [AXObject create:@"profiles" properties:@{@"sysObjectId":@"id1234"}];
+    profile[@"background"] = file;
+    [profile save:^(NSError *error) {
+        saveError = error;
+        [exp1 fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertNotNil(saveError);
+        XCTAssertFalse(fileRequested);
+    }];
+}
+
+- (void)testShouldUploadLargeFileInChunksAndReportProgress {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSMutableArray *ranges = [NSMutableArray array];
+    __block NSMutableSet *uploadIDs = [NSMutableSet set];
+    __block NSMutableData *received = [NSMutableData data];
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:@"clouds" ofType:@"jpg"];
+    NSData *realFileData = [NSData dataWithContentsOfFile:path];
+    [received setLength:realFileData.length];
+    
+    [AXStubs method:@"PUT" urlPath:@"/objects/profiles/id1234" response:@{} statusCode:200];
+    [AXStubs method:@"PUT"
+            urlPath:@"/files/profiles/id1234/background/clouds.jpg"
+         responding:^OHHTTPStubsResponse *(NSURLRequest *request) {
+             NSString *range = request.allHTTPHeaderFields[@"Content-Range"];
+             NSData *body = [NSURLProtocol propertyForKey:@"HTTPBody" inRequest:request];
+             unsigned long long start = 0;
+             [[NSScanner scannerWithString:[range substringFromIndex:6]] scanUnsignedLongLong:&start];
+             @synchronized(ranges) {
+                 [received replaceBytesInRange:NSMakeRange((NSUInteger)start, body.length) withBytes:body.bytes];
+                 [ranges addObject:range];
+                 [uploadIDs addObject:request.allHTTPHeaderFields[@"x-appstax-upload-id"]];
+             }
+             return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:200 headers:nil];
+         }];
+    
+    [[[Appstax defaultContext] fileService] setChunkedUploadThreshold:1];
+    [[[Appstax defaultContext] fileService] setUploadChunkSize:1024 * 1024];
+    AXFile *file = [AXFile fileWithPath:path];
+    AXObject *profile = [AXObject create:@"profiles" properties:@{@"sysObjectId":@"id1234"}];
+    profile[@"background"] = file;
+    [profile save:^(NSError *error) {
+        [exp1 fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:10 handler:^(NSError *error) {
+        XCTAssertEqual(ranges.count, 4);
+        XCTAssertTrue([ranges containsObject:@"bytes 0-1048575/3221596"]);
+        XCTAssertTrue([ranges containsObject:@"bytes 3145728-3221595/3221596"]);
+        XCTAssertEqual(uploadIDs.count, 1);
+        XCTAssertTrue([received isEqualToData:realFileData]);
+        XCTAssertEqual(file.status, AXFileStatusSaved);
+        XCTAssertEqual(file.bytesUploaded, 3221596);
+        XCTAssertEqual(file.totalBytes, 3221596);
+        XCTAssertEqualWithAccuracy(file.uploadProgress, 1, 0.0001);
+    }];
+}
+
+- (void)testShouldResumeChunkedUploadWithOnlyMissingChunks {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block XCTestExpectation *exp2 = [self expectationWithDescription:@"async2"];
+    __block NSMutableArray *ranges = [NSMutableArray array];
+    __block BOOL failSecondChunk = YES;
+    __block NSError *firstError;
+    __block NSError *secondError;
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:@"clouds" ofType:@"jpg"];
+    
+    [AXStubs method:@"PUT" urlPath:@"/objects/profiles/id1234" response:@{} statusCode:200];
+    [AXStubs method:@"PUT"
+            urlPath:@"/files/profiles/id1234/background/clouds.jpg"
+         responding:^OHHTTPStubsResponse *(NSURLRequest *request) {
+             NSString *range = request.allHTTPHeaderFields[@"Content-Range"];
+             @synchronized(ranges) {
+                 [ranges addObject:range];
+             }
+             if(failSecondChunk && [range hasPrefix:@"bytes 1048576-"]) {
+                 return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:503 headers:nil];
+             }
+             return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:200 headers:nil];
+         }];
+    
+    [[[Appstax defaultContext] fileService] setChunkedUploadThreshold:1];
+    [[[Appstax defaultContext] fileService] setUploadChunkSize:1024 * 1024];
+    [[[Appstax defaultContext] fileService] setMaxConcurrentChunkUploads:1];
+    AXFile *file = [AXFile fileWithPath:path];
+    AXObject *profile = [AXObject create:@"profiles" properties:@{@"sysObjectId":@"id1234"}];
+    profile[@"background"] = file;
+    [profile save:^(NSError *error) {
+        firstError = error;
+        failSecondChunk = NO;
+        [ranges removeAllObjects];
+        [exp1 fulfill];
+        [profile save:^(NSError *error) {
+            secondError = error;
+            [exp2 fulfill];
+        }];
+    }];
+    
+    [self waitForExpectationsWithTimeout:10 handler:^(NSError *error) {
+        XCTAssertNotNil(firstError);
+        XCTAssertNil(secondError);
+        XCTAssertEqualObjects(ranges, (@[@"bytes 1048576-2097151/3221596",
+                                         @"bytes 2097152-3145727/3221596",
+                                         @"bytes 3145728-3221595/3221596"]));
+        XCTAssertEqual(file.status, AXFileStatusSaved);
+        XCTAssertEqual(file.bytesUploaded, 3221596);
+    }];
+}
+
 - (void)testShouldLoadFileDataOnRequest {
     __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
     __block NSData *realFileData = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"clouds" ofType:@"jpg"]];
@@ -432,6 +571,7 @@
     __block NSMutableArray *imageRequests = [NSMutableArray array];
     __block NSData *fileData = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"clouds" ofType:@"jpg"]];
     __block AXFile *file;
+    [[[Appstax defaultContext] fileService] setMaxConcurrentDownloads:6];
     
     [AXStubs method:@"GET" urlPath:@"/objects/notes/001"
            response:@{@"sysObjectId":@"001",
@@ -481,4 +621,106 @@
 
 }
 
+- (void)testShouldStartNewestVisibleDownloadsFirstAndSkipCancelledDownloads {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSMutableArray *requestedPaths = [NSMutableArray array];
+    __block NSMutableArray *completedPaths = [NSMutableArray array];
+    AXFileService *fileService = [[Appstax defaultContext] fileService];
+    fileService.maxConcurrentDownloads = 1;
+    
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.pathComponents[1] isEqualToString:@"files"];
+    } withStubResponse:^OHHTTPStubsResponse *(NSURLRequest *request) {
+        [requestedPaths addObject:request.URL.path];
+        return [[OHHTTPStubsResponse responseWithData:[NSData data] statusCode:200 headers:@{}] responseTime:0.1];
+    }];
+    
+    void(^download)(NSString *, AXDownloadPriority) = ^(NSString *name, AXDownloadPriority priority) {
+        NSURL *url = [NSURL URLWithString:[@"http://localhost:3000/files/" stringByAppendingString:name]];
+        [fileService downloadDataFromUrl:url priority:priority completion:^(NSData *data, NSError *error) {
+            [completedPaths addObject:name];
+            if(completedPaths.count == 5) {
+                [exp1 fulfill];
+            }
+        }];
+    };
+    download(@"a", AXDownloadPriorityVisible);
+    download(@"b", AXDownloadPriorityBackground);
+    download(@"c", AXDownloadPriorityPrefetch);
+    download(@"d", AXDownloadPriorityVisible);
+    id cancelled = [fileService downloadDataFromUrl:[NSURL URLWithString:@"http://localhost:3000/files/e"]
+                                           priority:AXDownloadPriorityVisible
+                                         completion:^(NSData *data, NSError *error) {
+                                             [completedPaths addObject:@"e"];
+                                         }];
+    download(@"f", AXDownloadPriorityVisible);
+    [fileService cancelDownload:cancelled];
+    
+    [self waitForExpectationsWithTimeout:5 handler:^(NSError *error) {
+        NSArray *expected = @[@"/files/a", @"/files/f", @"/files/d", @"/files/c", @"/files/b"];
+        XCTAssertEqualObjects(expected, requestedPaths);
+        XCTAssertFalse([completedPaths containsObject:@"e"]);
+    }];
+}
+
+- (void)testShouldMoveLoadedDataToDiskWhenOverBudgetAndReloadItOnAccess {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSData *realFileData = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"clouds" ofType:@"jpg"]];
+    AXFileDataCache *dataCache = [[[Appstax defaultContext] fileService] dataCache];
+    [dataCache evictAllData];
+    dataCache.memoryBudget = realFileData.length + realFileData.length / 2;
+    NSUInteger evictionCount = dataCache.evictionCount;
+    
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.pathComponents[1] isEqualToString:@"files"];
+    } withStubResponse:^OHHTTPStubsResponse *(NSURLRequest *request) {
+        return [OHHTTPStubsResponse responseWithData:realFileData statusCode:200 headers:@{}];
+    }];
+    
+    AXFile *file1 = [AXFile fileWithUrl:[NSURL URLWithString:@"http://localhost:3000/files/notes/001/attachment/1.jpg"] name:@"1.jpg" status:AXFileStatusSaved];
+    AXFile *file2 = [AXFile fileWithUrl:[NSURL URLWithString:@"http://localhost:3000/files/notes/001/attachment/2.jpg"] name:@"2.jpg" status:AXFileStatusSaved];
+    [file1 load:^(NSError *error) {
+        [file2 load:^(NSError *error) {
+            [exp1 fulfill];
+        }];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqual(dataCache.residentBytes, realFileData.length);
+        XCTAssertEqual(dataCache.spilledBytes, realFileData.length);
+        XCTAssertEqual(dataCache.evictionCount, evictionCount + 1);
+        XCTAssertTrue([file1.data isEqualToData:realFileData]);
+        XCTAssertEqual(dataCache.evictionCount, evictionCount + 2);
+        XCTAssertTrue([file2.data isEqualToData:realFileData]);
+        [file1 unload];
+        [file2 unload];
+        XCTAssertEqual(dataCache.residentBytes, 0);
+        XCTAssertEqual(dataCache.spilledBytes, 0);
+        dataCache.memoryBudget = 32 * 1024 * 1024;
+    }];
+}
+
+- (void)testShouldReloadSpilledDataAfterFileServiceIsReplaced {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSData *realFileData = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"clouds" ofType:@"jpg"]];
+    
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.pathComponents[1] isEqualToString:@"files"];
+    } withStubResponse:^OHHTTPStubsResponse *(NSURLRequest *request) {
+        return [OHHTTPStubsResponse responseWithData:realFileData statusCode:200 headers:@{}];
+    }];
+    
+    AXFile *file = [AXFile fileWithUrl:[NSURL URLWithString:@"http://localhost:3000/files/notes/001/attachment/1.jpg"] name:@"1.jpg" status:AXFileStatusSaved];
+    [file load:^(NSError *error) {
+        [[[[Appstax defaultContext] fileService] dataCache] evictAllData];
+        [Appstax setAppKey:@"test-api-key" baseUrl:@"http://localhost:3000/"];
+        [exp1 fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertTrue([file.data isEqualToData:realFileData]);
+        [file unload];
+    }];
+}
+
 @end
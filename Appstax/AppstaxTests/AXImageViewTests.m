@@ -18,6 +18,7 @@
     [OHHTTPStubs setEnabled:YES];
     [Appstax setAppKey:@"test-api-key" baseUrl:@"http://localhost:3000/"];
     _apiClient = [[Appstax defaultContext] apiClient];
+    [[[[Appstax defaultContext] fileService] imageCache] removeAllImages];
 }
 
 - (void)tearDown {
@@ -131,7 +132,6 @@
 }
 
 - (void)testShouldLoadLatestFileInRaceConditions {
-    __block int exp1Count = 0;
     __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
     __block NSData *fileData1 = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"safari" ofType:@"png"]];
     __block NSData *fileData2 = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"safari_green" ofType:@"png"]];
@@ -139,12 +139,6 @@
     [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
         return [request.URL.pathComponents[1] isEqualToString:@"files"];
     } withStubResponse:^OHHTTPStubsResponse *(NSURLRequest *request) {
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
-            exp1Count++;
-            if(exp1Count == 2) {
-                [exp1 fulfill];
-            }
-        });
         if([request.URL.absoluteString containsString:@"file1.png"]) {
             return [[OHHTTPStubsResponse responseWithData:fileData1 statusCode:200 headers:@{}] requestTime:0 responseTime:3];
         } else {
@@ -159,6 +153,9 @@
     AXFile *file2 = [AXFile fileWithUrl:[NSURL URLWithString:@"http://localhost:3000/files/profiles/image/file2.png"] name:@"me" status:AXFileStatusSaved];
     [view loadFile:file1];
     [view loadFile:file2];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [exp1 fulfill];
+    });
     
     [self waitForExpectationsWithTimeout:15 handler:^(NSError *error) {
         XCTAssertNotNil(view.image);
@@ -170,7 +167,6 @@
 }
 
 - (void)testShouldLoadLatestResizedImageInRaceConditions {
-    __block int exp1Count = 0;
     __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
     __block NSData *fileData1 = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"safari" ofType:@"png"]];
     __block NSData *fileData2 = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"safari_green" ofType:@"png"]];
@@ -178,12 +174,6 @@
     [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
         return [request.URL.pathComponents[1] isEqualToString:@"images"];
     } withStubResponse:^OHHTTPStubsResponse *(NSURLRequest *request) {
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
-            exp1Count++;
-            if(exp1Count == 2) {
-                [exp1 fulfill];
-            }
-        });
         if([request.URL.absoluteString containsString:@"file1.png"]) {
             return [[OHHTTPStubsResponse responseWithData:fileData1 statusCode:200 headers:@{}] requestTime:0 responseTime:3];
         } else {
@@ -198,6 +188,9 @@
     AXFile *file2 = [AXFile fileWithUrl:[NSURL URLWithString:@"http://localhost:3000/files/profiles/image/file2.png"] name:@"me" status:AXFileStatusSaved];
     [view loadFile:file1 size:CGSizeMake(100, 100) crop:YES];
     [view loadFile:file2 size:CGSizeMake(100, 100) crop:YES];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [exp1 fulfill];
+    });
     
     [self waitForExpectationsWithTimeout:15 handler:^(NSError *error) {
         XCTAssertNotNil(view.image);
@@ -208,4 +201,33 @@
     }];
 }
 
+- (void)testShouldShareDownloadsAndReuseDecodedImages {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSData *fileData = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"safari" ofType:@"png"]];
+    __block int requestCount = 0;
+    
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [request.URL.pathComponents[1] isEqualToString:@"images"];
+    } withStubResponse:^OHHTTPStubsResponse *(NSURLRequest *request) {
+        requestCount++;
+        return [[OHHTTPStubsResponse responseWithData:fileData statusCode:200 headers:@{}] requestTime:0 responseTime:0.5];
+    }];
+    
+    AXFile *file = [AXFile fileWithUrl:[NSURL URLWithString:@"http://localhost:3000/files/profiles/image/shared.png"] name:@"shared" status:AXFileStatusSaved];
+    AXImageView *view1 = [AXImageView viewWithFile:file size:CGSizeMake(50,50) crop:YES];
+    AXImageView *view2 = [AXImageView viewWithFile:file size:CGSizeMake(50,50) crop:YES];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(2 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [exp1 fulfill];
+    });
+    
+    [self waitForExpectationsWithTimeout:5 handler:^(NSError *error) {
+        XCTAssertEqual(requestCount, 1);
+        XCTAssertNotNil(view1.image);
+        XCTAssertEqual(view1.image, view2.image);
+        AXImageView *view3 = [AXImageView viewWithFile:file size:CGSizeMake(50,50) crop:YES];
+        XCTAssertEqual(view3.image, view1.image);
+        XCTAssertEqual(requestCount, 1);
+    }];
+}
+
 @end
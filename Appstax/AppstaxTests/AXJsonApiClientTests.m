@@ -1,6 +1,7 @@
 
 #import <XCTest/XCTest.h>
 @import Appstax;
+#import "AppstaxInternals.h"
 #import "AXAsssertions.h"
 #import "OHHTTPStubs.h"
 #import "OHHTTPStubsResponse+JSON.h"
@@ -209,4 +210,205 @@
     }];
 }
 
+- (void)testDictionaryFromUrlShouldRevalidateWithETag {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    
+    __block NSMutableArray *ifNoneMatchHeaders = [NSMutableArray array];
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        NSString *ifNoneMatch = [request valueForHTTPHeaderField:@"If-None-Match"];
+        [ifNoneMatchHeaders addObject:ifNoneMatch ?: @""];
+        if ([ifNoneMatch isEqualToString:@"\"v1\""]) {
+            return [OHHTTPStubsResponse responseWithData:[NSData data] statusCode:304 headers:nil];
+        }
+        return [OHHTTPStubsResponse responseWithJSONObject:@{@"objects":@[@"a", @"b"]}
+                                                statusCode:200 headers:@{@"ETag":@"\"v1\""}];
+    }];
+    
+    NSURL *url = [NSURL URLWithString:@"http://example.com/objects/items"];
+    __block NSDictionary *firstDictionary;
+    __block NSDictionary *secondDictionary;
+    __block NSError *secondError;
+    [_apiClient dictionaryFromUrl:url completion:^(NSDictionary *dictionary, NSError *error) {
+        firstDictionary = dictionary;
+        [_apiClient dictionaryFromUrl:url completion:^(NSDictionary *dictionary, NSError *error) {
+            secondDictionary = dictionary;
+            secondError = error;
+            [exp1 fulfill];
+        }];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqualObjects(ifNoneMatchHeaders, (@[@"", @"\"v1\""]));
+        XCTAssertNil(secondError);
+        XCTAssertEqualObjects(firstDictionary, (@{@"objects":@[@"a", @"b"]}));
+        XCTAssertEqualObjects(secondDictionary, firstDictionary);
+        XCTAssertEqual(_apiClient.validatedResponseHits, 1);
+        XCTAssertEqual(_apiClient.validatedResponseMisses, 1);
+    }];
+}
+
+- (void)testShouldNotSendValidatorsForResponsesWithoutThem {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    
+    __block NSMutableArray *validatorHeaders = [NSMutableArray array];
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        [validatorHeaders addObject:[request valueForHTTPHeaderField:@"If-None-Match"] ?: @""];
+        [validatorHeaders addObject:[request valueForHTTPHeaderField:@"If-Modified-Since"] ?: @""];
+        return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:200 headers:nil];
+    }];
+    
+    NSURL *url = [NSURL URLWithString:@"http://example.com/objects/items"];
+    [_apiClient dictionaryFromUrl:url completion:^(NSDictionary *dictionary, NSError *error) {
+        [_apiClient dictionaryFromUrl:url completion:^(NSDictionary *dictionary, NSError *error) {
+            [exp1 fulfill];
+        }];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqualObjects(validatorHeaders, (@[@"", @"", @"", @""]));
+        XCTAssertEqual(_apiClient.validatedResponseHits, 0);
+        XCTAssertEqual(_apiClient.validatedResponseMisses, 2);
+    }];
+}
+
+- (void)testShouldGzipLargeRequestBodiesWhenEnabled {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSData *httpBody;
+    __block NSString *contentEncoding;
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        httpBody = [NSURLProtocol propertyForKey:@"HTTPBody" inRequest:request];
+        contentEncoding = [request valueForHTTPHeaderField:@"Content-Encoding"];
+        return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:200 headers:nil];
+    }];
+    
+    _apiClient.requestCompressionThreshold = 100;
+    NSString *longValue = [@"" stringByPaddingToLength:1000 withString:@"abc" startingAtIndex:0];
+    [_apiClient postDictionary:@{@"prop1":longValue}
+                         toUrl:[NSURL URLWithString:@"http://example1.com"]
+                    completion:^(NSDictionary *dictionary, NSError *error) {
+                        [exp1 fulfill];
+                    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqualObjects(contentEncoding, @"gzip");
+        XCTAssertLessThan(httpBody.length, 1000);
+        NSData *uncompressed = [AXCompression gunzipData:httpBody];
+        NSDictionary *bodyDictionary = [NSJSONSerialization JSONObjectWithData:uncompressed options:0 error:nil];
+        XCTAssertEqualObjects(bodyDictionary[@"prop1"], longValue);
+    }];
+}
+
+- (void)testShouldNotGzipSmallRequestBodies {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSString *contentEncoding = @"not set";
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        contentEncoding = [request valueForHTTPHeaderField:@"Content-Encoding"];
+        return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:200 headers:nil];
+    }];
+    
+    _apiClient.requestCompressionThreshold = 100;
+    [_apiClient putDictionary:@{@"prop1":@"value1"}
+                        toUrl:[NSURL URLWithString:@"http://example1.com"]
+                   completion:^(NSDictionary *dictionary, NSError *error) {
+                       [exp1 fulfill];
+                   }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertNil(contentEncoding);
+    }];
+}
+
+- (void)testShouldRetryPostWithSameIdempotencyKey {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSMutableArray *keys = [NSMutableArray array];
+    __block NSError *responseError;
+    __block AXRequestMetrics *metrics;
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        [keys addObject:[request valueForHTTPHeaderField:@"x-appstax-idempotency-key"] ?: @""];
+        int statusCode = keys.count == 1 ? 503 : 200;
+        return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:statusCode headers:nil];
+    }];
+    
+    _apiClient.retryBaseDelay = 0.01;
+    _apiClient.retryPosts = YES;
+    _apiClient.metricsHandler = ^(AXRequestMetrics *requestMetrics) {
+        metrics = requestMetrics;
+        [exp1 fulfill];
+    };
+    [_apiClient postDictionary:@{@"prop1":@"value1"}
+                         toUrl:[NSURL URLWithString:@"http://example1.com"]
+                    completion:^(NSDictionary *dictionary, NSError *error) {
+                        responseError = error;
+                    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertNil(responseError);
+        XCTAssertEqual(keys.count, 2);
+        XCTAssertTrue([keys[0] length] > 0);
+        XCTAssertEqualObjects(keys[0], keys[1]);
+        XCTAssertEqual(metrics.attempts, 2);
+        XCTAssertEqual(metrics.statusCode, 200);
+    }];
+}
+
+- (void)testShouldNotRetryPostByDefault {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSMutableArray *keys = [NSMutableArray array];
+    __block NSError *responseError;
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        [keys addObject:[request valueForHTTPHeaderField:@"x-appstax-idempotency-key"] ?: @""];
+        return [OHHTTPStubsResponse responseWithJSONObject:@{} statusCode:503 headers:nil];
+    }];
+    
+    _apiClient.retryBaseDelay = 0.01;
+    [_apiClient postDictionary:@{@"prop1":@"value1"}
+                         toUrl:[NSURL URLWithString:@"http://example1.com"]
+                    completion:^(NSDictionary *dictionary, NSError *error) {
+                        responseError = error;
+                        [exp1 fulfill];
+                    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertNotNil(responseError);
+        XCTAssertEqualObjects(keys, @[@""]);
+    }];
+}
+
+- (void)testShouldNotRetryClientErrors {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block int requestCount = 0;
+    __block NSError *responseError;
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return YES;
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        requestCount++;
+        return [OHHTTPStubsResponse responseWithJSONObject:@{@"errorMessage":@"Bad"} statusCode:400 headers:nil];
+    }];
+    
+    _apiClient.retryBaseDelay = 0.01;
+    [_apiClient putDictionary:@{@"prop1":@"value1"}
+                        toUrl:[NSURL URLWithString:@"http://example1.com"]
+                   completion:^(NSDictionary *dictionary, NSError *error) {
+                       responseError = error;
+                       [exp1 fulfill];
+                   }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqual(requestCount, 1);
+        XCTAssertEqual(responseError.code, 400);
+    }];
+}
+
 @end
@@ -341,6 +341,64 @@ import XCTest
         }
     }
     
+    func testShouldReportChangesInOneEventWithIndexesAndSortByNumbers() {
+        weak var async = expectationWithDescription("async")
+        AXStubs.method("GET", urlPath: "/objects/posts") { request in
+            return OHHTTPStubsResponse(JSONObject: ["objects":[
+                ["sysObjectId": "id1", "rank": 10],
+                ["sysObjectId": "id2", "rank": 2],
+                ["sysObjectId": "id3", "rank": 30]
+                ]], statusCode: 200, headers: [:])
+        }
+        
+        let model = AXModel()
+        model.watch("posts", order: "rank")
+        
+        var events: [AXModelEvent] = []
+        delay(0.5) {
+            model.on("change") { events.append($0) }
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.created",
+                "channel": "objects/posts",
+                "data": ["sysObjectId": "id4", "rank": 20]
+                ])
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.updated",
+                "channel": "objects/posts",
+                "data": ["sysObjectId": "id2", "rank": 40]
+                ])
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.updated",
+                "channel": "objects/posts",
+                "data": ["sysObjectId": "id1", "rank": 10, "title": "hello"]
+                ])
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.deleted",
+                "channel": "objects/posts",
+                "data": ["sysObjectId": "id3"]
+                ])
+            delay(0.5) {
+                async?.fulfill()
+            }
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            let ids = (model["posts"] as! [AXObject]).map() { $0.objectID! }.joinWithSeparator(",")
+            AXAssertEqual(ids, "id1,id4,id2")
+            AXAssertEqual(events.count, 1)
+            AXAssertEqual(events[0].name, "posts")
+            AXAssertEqual(events[0].insertedIndexes, [1])
+            AXAssertEqual(events[0].deletedIndexes, [2])
+            XCTAssertTrue(events[0].movedIndexes == [1: 0])
+            AXAssertEqual(events[0].updatedIndexes, [0])
+            AXAssertEqual(events[0].insertedObjects.map({ $0.objectID! }), ["id4"])
+            AXAssertEqual(events[0].deletedObjects.map({ $0.objectID! }), ["id3"])
+            AXAssertEqual(events[0].updatedObjects.map({ $0.objectID! }), ["id1", "id2"])
+            AXAssertEqual(events[0].changedKeys["id1"], ["title"])
+            AXAssertEqual(events[0].changedKeys["id2"], ["rank"])
+        }
+    }
+    
     func testShouldRemoveObjectWhenReceivingObjectDeleted() {
         weak var async = expectationWithDescription("async")
         AXStubs.method("GET", urlPath: "/objects/posts") { request in
@@ -420,28 +478,66 @@ import XCTest
             changes += 1
         }
         
-        self.realtimeService.webSocketDidReceiveMessage([
-            "event": "object.created",
-            "channel": "objects/posts",
-            "data": ["sysObjectId": "id1"]
-        ])
-        self.realtimeService.webSocketDidReceiveMessage([
-            "event": "object.updated",
-            "channel": "objects/posts",
-            "data": ["sysObjectId": "id1"]
-        ])
-        self.realtimeService.webSocketDidReceiveMessage([
-            "event": "object.deleted",
-            "channel": "objects/posts",
-            "data": ["sysObjectId": "id1"]
-        ])
-        
-        delay(0.3) { async?.fulfill() }
-        waitForExpectationsWithTimeout(1) { error in
+        delay(0.3) {
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.created",
+                "channel": "objects/posts",
+                "data": ["sysObjectId": "id2"]
+            ])
+            delay(0.1) {
+                self.realtimeService.webSocketDidReceiveMessage([
+                    "event": "object.updated",
+                    "channel": "objects/posts",
+                    "data": ["sysObjectId": "id1", "prop": "value2"]
+                ])
+                delay(0.1) {
+                    self.realtimeService.webSocketDidReceiveMessage([
+                        "event": "object.deleted",
+                        "channel": "objects/posts",
+                        "data": ["sysObjectId": "id1"]
+                    ])
+                    delay(0.3) { async?.fulfill() }
+                }
+            }
+        }
+        waitForExpectationsWithTimeout(3) { error in
             AXAssertEqual(changes, 4)
         }
     }
     
+    func testShouldOnlyTriggerChangeEventForUpdatesToObjectsInTheModel() {
+        weak var async = expectationWithDescription("async")
+        AXStubs.method("GET", urlPath: "/objects/items", query: "expanddepth=1", response: itemsResponse, statusCode: 200)
+        
+        let model = AXModel()
+        model.watch("items", expand: 1)
+        
+        var changes = 0
+        delay(0.3) {
+            model.on("change") { _ in
+                changes += 1
+            }
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.updated",
+                "channel": "objects/items",
+                "data": ["sysObjectId": "id9"]
+            ])
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.updated",
+                "channel": "objects/collection3",
+                "data": ["sysObjectId": "id3", "prop4": "value4b new!"]
+            ])
+            delay(0.3) {
+                async?.fulfill()
+            }
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(changes, 1)
+            AXAssertEqual(model["items"]?[0].objects("prop2")?[1]["prop4"], "value4b new!")
+        }
+    }
+    
     func testShouldAddFilteredArrayPropertyAndSubscribeToFilteredObjects() {
         weak var async = expectationWithDescription("async")
         AXStubs.method("GET", urlPath: "/objects/posts", query:"filter=foo%3D%27bar%27") { request in
@@ -633,6 +729,44 @@ import XCTest
         }
     }
     
+    func testShouldReorderObjectsWhenRelatedObjectInSortPathChanges() {
+        weak var async = expectationWithDescription("async")
+        let owner: (String, String) -> [String:AnyObject] = { id, name in
+            return [
+                "sysDatatype": "relation",
+                "sysRelationType": "single",
+                "sysCollection": "owners",
+                "sysObjects": [["sysObjectId": id, "name": name]]
+            ]
+        }
+        AXStubs.method("GET", urlPath: "/objects/items", query: "expanddepth=1", response: ["objects": [
+            ["sysObjectId": "item1", "owner": owner("owner1", "b")],
+            ["sysObjectId": "item2", "owner": owner("owner2", "c")]
+        ]], statusCode: 200)
+        
+        let model = AXModel()
+        model.watch("items", collection: "items", expand: 1, order: "owner.name", filter: nil)
+        
+        var idsBefore = ""
+        delay(0.3) {
+            idsBefore = (model["items"] as! [AXObject]).map() { $0.objectID! }.joinWithSeparator(",")
+            self.realtimeService.webSocketDidReceiveMessage([
+                "event": "object.updated",
+                "channel": "objects/owners",
+                "data": ["sysObjectId": "owner1", "name": "d"]
+            ])
+            delay(0.3) {
+                async?.fulfill()
+            }
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(idsBefore, "item1,item2")
+            let ids = (model["items"] as! [AXObject]).map() { $0.objectID! }.joinWithSeparator(",")
+            AXAssertEqual(ids, "item2,item1")
+        }
+    }
+    
     func testShouldReExpandRelationsWhenUpdatingAnObjectLoadedWithRelations() {
         weak var async = expectationWithDescription("async")
         
@@ -1231,6 +1365,48 @@ import XCTest
         }
     }
     
+    func testShouldOnlyLoadObjectsUpdatedSinceNewestSeenAfterShortReconnection() {
+        weak var async = expectationWithDescription("async")
+        
+        var filters: [String] = []
+        AXStubs.method("GET", urlPath: "/objects/posts") { request in
+            let components = NSURLComponents(URL: request.URL!, resolvingAgainstBaseURL: false)
+            if let filter = components?.queryItems?.filter({ $0.name == "filter" }).first?.value {
+                filters.append(filter)
+                return OHHTTPStubsResponse(JSONObject: ["objects":[
+                    ["sysObjectId": "id2", "content": "2b", "sysCreated": "2015-08-19T10:00:00", "sysUpdated": "2015-08-20T10:00:00"],
+                    ["sysObjectId": "id3", "content": "3a", "sysCreated": "2015-08-20T11:00:00", "sysUpdated": "2015-08-20T11:00:00"]
+                    ]], statusCode: 200, headers: [:])
+            }
+            return OHHTTPStubsResponse(JSONObject: ["objects":[
+                ["sysObjectId": "id1", "content": "1a", "sysCreated": "2015-08-19T11:00:00", "sysUpdated": "2015-08-19T12:00:00"],
+                ["sysObjectId": "id2", "content": "2a", "sysCreated": "2015-08-19T10:00:00", "sysUpdated": "2015-08-19T10:00:00"]
+                ]], statusCode: 200, headers: [:])
+        }
+        AXStubs.method("POST", urlPath: "/messaging/realtime/sessions") { request in
+            return OHHTTPStubsResponse(JSONObject: ["realtimeSessionId":"testrsession"], statusCode: 200, headers: [:])
+        }
+        realtimeService.webSocketFactory = { _ in
+            return MockWebSocket(self.realtimeService)
+        }
+        
+        let model = AXModel()
+        model.deltaResync = true
+        model.watch("posts")
+        
+        delay(1) {
+            self.realtimeService.webSocketDidDisconnect(nil)
+            delay(3) { async?.fulfill() }
+        }
+        
+        waitForExpectationsWithTimeout(5) { error in
+            AXAssertEqual(filters, ["sysUpdated>='2015-08-19T12:00:00'"])
+            let ids = (model["posts"] as! [AXObject]).map() { $0.objectID! }.joinWithSeparator(",")
+            AXAssertEqual(ids, "id3,id1,id2")
+            AXAssertEqual(model["posts"]?[2]["content"], "2b")
+        }
+    }
+    
     // MARK: Error handling
     
     func testShouldGetErrorEventWhenLoadingFails() {
@@ -222,9 +222,68 @@
     
     [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
         XCTAssertEqualObjects(putData[@"sysObjectId"], @"42");
-        XCTAssertEqualObjects(putData[@"sysCreated"], @"2014-09-11 09:20:18.762809+02");
-        XCTAssertEqualObjects(putData[@"foo"], @"bar");
         XCTAssertEqualObjects(putData[@"foz"], @"baz");
+        XCTAssertNil(putData[@"sysCreated"]);
+        XCTAssertNil(putData[@"foo"]);
+    }];
+}
+
+- (void)testShouldOnlyPutPropertiesChangedSinceLastSave {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSMutableArray *putData = [NSMutableArray array];
+    
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [[request.URL path] isEqualToString:@"/objects/answer/42"] &&
+        [request.HTTPMethod isEqualToString:@"PUT"];
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        NSData *httpBody = [NSURLProtocol propertyForKey:@"HTTPBody" inRequest:request];
+        [putData addObject:[NSJSONSerialization JSONObjectWithData:httpBody options:0 error:nil]];
+        return [OHHTTPStubsResponse responseWithJSONObject:@{}
+                                                statusCode:200 headers:nil];
+    }];
+    
+    AXObject *object = [AXObject create:@"answer" properties:@{@"sysObjectId":@"42",@"foo":@"bar"}];
+    object[@"foz"] = @"baz";
+    [object save:^(NSError *error) {
+        object[@"fiz"] = @"buz";
+        [object save:^(NSError *error) {
+            [exp1 fulfill];
+        }];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqual(putData.count, 2);
+        XCTAssertEqualObjects(putData[0], (@{@"sysObjectId":@"42",@"foz":@"baz"}));
+        XCTAssertEqualObjects(putData[1], (@{@"sysObjectId":@"42",@"fiz":@"buz"}));
+    }];
+}
+
+- (void)testShouldPutNullForPropertiesSetToNil {
+    __block XCTestExpectation *exp1 = [self expectationWithDescription:@"async1"];
+    __block NSMutableArray *putData = [NSMutableArray array];
+    
+    [OHHTTPStubs stubRequestsPassingTest:^BOOL(NSURLRequest *request) {
+        return [[request.URL path] isEqualToString:@"/objects/answer/42"] &&
+        [request.HTTPMethod isEqualToString:@"PUT"];
+    } withStubResponse:^OHHTTPStubsResponse*(NSURLRequest *request) {
+        NSData *httpBody = [NSURLProtocol propertyForKey:@"HTTPBody" inRequest:request];
+        [putData addObject:[NSJSONSerialization JSONObjectWithData:httpBody options:0 error:nil]];
+        return [OHHTTPStubsResponse responseWithJSONObject:@{}
+                                                statusCode:200 headers:nil];
+    }];
+    
+    AXObject *object = [AXObject create:@"answer" properties:@{@"sysObjectId":@"42",@"foo":@"bar"}];
+    object[@"foo"] = nil;
+    [object save:^(NSError *error) {
+        [object save:^(NSError *error) {
+            [exp1 fulfill];
+        }];
+    }];
+    
+    [self waitForExpectationsWithTimeout:3 handler:^(NSError *error) {
+        XCTAssertEqual(putData.count, 2);
+        XCTAssertEqualObjects(putData[0], (@{@"sysObjectId":@"42",@"foo":[NSNull null]}));
+        XCTAssertEqualObjects(putData[1], (@{@"sysObjectId":@"42"}));
     }];
 }
 
@@ -0,0 +1,161 @@
+
+import Foundation
+import XCTest
+@testable import Appstax
+
+@objc class ObjectCacheTests: XCTestCase {
+    
+    var cachePath = ""
+    
+    override func setUp() {
+        super.setUp()
+        OHHTTPStubs.setEnabled(true)
+        OHHTTPStubs.removeAllStubs()
+        Appstax.setAppKey("test-api-key", baseUrl:"http://localhost:3000/");
+        Appstax.setLogLevel("debug");
+        cachePath = (NSTemporaryDirectory() as NSString).stringByAppendingPathComponent("ObjectCacheTests-\(NSUUID().UUIDString).log")
+    }
+    
+    override func tearDown() {
+        super.tearDown()
+        OHHTTPStubs.setEnabled(false)
+        _ = try? NSFileManager.defaultManager().removeItemAtPath(cachePath)
+    }
+    
+    func itemUrl(query: String) -> NSURL {
+        return NSURL(string: "http://localhost:3000/objects/items?filter=\(query)")!
+    }
+    
+    func testFindAllShouldReturnCachedObjectsBeforeRevalidatedObjects() {
+        let objectService = Appstax.defaultContext.objectService
+        objectService.objectCache = AXObjectCache(path: cachePath)
+        
+        var responseObjects = [["sysObjectId": "id1", "sysUpdated": "2016-01-01", "name": "old name"]]
+        var requestCount = 0
+        AXStubs.method("GET", urlPath: "/objects/items") { request in
+            requestCount += 1
+            return OHHTTPStubsResponse(JSONObject: ["objects": responseObjects], statusCode: 200, headers: [:]).responseTime(0.2)
+        }
+        
+        let firstLoad = expectationWithDescription("first load")
+        objectService.findAll("items", options: nil) { objects, error in
+            AXAssertEqual(objects?.first?["name"], "old name")
+            firstLoad.fulfill()
+        }
+        waitForExpectationsWithTimeout(3, handler: nil)
+        
+        responseObjects = [["sysObjectId": "id1", "sysUpdated": "2016-01-02", "name": "new name"]]
+        var names: [String] = []
+        let secondLoad = expectationWithDescription("second load")
+        objectService.findAll("items", options: nil) { objects, error in
+            names.append(objects?.first?["name"] as? String ?? "")
+            if names.count == 2 {
+                secondLoad.fulfill()
+            }
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(requestCount, 2)
+            AXAssertEqual(names, ["old name", "new name"])
+        }
+    }
+    
+    func testShouldNotCallCompletionAgainWhenRevalidatedObjectsAreUnchanged() {
+        let objectService = Appstax.defaultContext.objectService
+        objectService.objectCache = AXObjectCache(path: cachePath)
+        
+        AXStubs.method("GET", urlPath: "/objects/items") { request in
+            return OHHTTPStubsResponse(JSONObject: ["objects": [["sysObjectId": "id1", "name": "item"]]], statusCode: 200, headers: [:])
+        }
+        
+        let firstLoad = expectationWithDescription("first load")
+        objectService.find("items", queryString: "name='item'", options: nil) { objects, error in
+            firstLoad.fulfill()
+        }
+        waitForExpectationsWithTimeout(3, handler: nil)
+        
+        var completionCount = 0
+        objectService.find("items", queryString: "name='item'", options: nil) { objects, error in
+            completionCount += 1
+            AXAssertEqual(objects?.count, 1)
+        }
+        
+        let async = expectationWithDescription("async")
+        delay(0.5, async.fulfill)
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(completionCount, 1)
+        }
+    }
+    
+    func testCacheShouldBeLoadedFromLogFile() {
+        let cache = AXObjectCache(path: cachePath)
+        cache.storeProperties([["sysObjectId": "id1", "name": "a"], ["sysObjectId": "id2", "name": "b"]], collectionName: "items", forQuery: itemUrl("1"))
+        cache.storeProperties([["sysObjectId": "id2", "name": "b2"]], collectionName: "items", forQuery: itemUrl("2"))
+        cache.removeObject("items", id: "id1")
+        cache.waitUntilWritten()
+        
+        let loadedCache = AXObjectCache(path: cachePath)
+        let first = loadedCache.propertiesForQuery(itemUrl("1"))
+        let second = loadedCache.propertiesForQuery(itemUrl("2"))
+        AXAssertEqual(loadedCache.objectCount, 1)
+        AXAssertEqual(first?.count, 1)
+        AXAssertEqual(first?.first?["name"], "b2")
+        AXAssertEqual(second?.first?["name"], "b2")
+        AXAssertNil(loadedCache.propertiesForQuery(itemUrl("3")))
+    }
+    
+    func testShouldReadLogFileInBackgroundAndRunWhenLoadedOnMain() {
+        let async = expectationWithDescription("async")
+        let cache = AXObjectCache(path: cachePath)
+        cache.storeProperties([["sysObjectId": "id1", "name": "a"]], collectionName: "items", forQuery: itemUrl("1"))
+        cache.waitUntilWritten()
+        
+        let loadedCache = AXObjectCache(path: cachePath)
+        var loadedOnMain = false
+        loadedCache.whenLoaded() {
+            loadedOnMain = NSThread.isMainThread()
+            async.fulfill()
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            XCTAssertTrue(loadedOnMain)
+            AXAssertEqual(loadedCache.objectCount, 1)
+        }
+    }
+    
+    func testShouldRemoveCachedObjectsWhenUserLogsOut() {
+        let objectService = Appstax.defaultContext.objectService
+        let cache = AXObjectCache(path: cachePath)
+        objectService.objectCache = cache
+        cache.storeProperties([["sysObjectId": "id1", "name": "private"]], collectionName: "items", forQuery: itemUrl("1"))
+        
+        AXUser.logout()
+        
+        AXAssertEqual(cache.objectCount, 0)
+        AXAssertNil(cache.propertiesForQuery(itemUrl("1")))
+    }
+    
+    func testShouldKeepNewestVersionOfObject() {
+        let cache = AXObjectCache(path: cachePath)
+        cache.storeProperties([["sysObjectId": "id1", "sysUpdated": "2016-02-01", "name": "newer"]], collectionName: "items", forQuery: itemUrl("1"))
+        cache.storeProperties([["sysObjectId": "id1", "sysUpdated": "2016-01-01", "name": "older"]], collectionName: "items", forQuery: itemUrl("2"))
+        
+        AXAssertEqual(cache.propertiesForQuery(itemUrl("1"))?.first?["name"], "newer")
+        AXAssertEqual(cache.propertiesForQuery(itemUrl("2"))?.first?["name"], "newer")
+    }
+    
+    func testShouldEvictLeastRecentlyUsedQueriesWhenFull() {
+        let cache = AXObjectCache(path: cachePath)
+        cache.maxObjectCount = 4
+        cache.storeProperties([["sysObjectId": "a1"], ["sysObjectId": "a2"]], collectionName: "items", forQuery: itemUrl("a"))
+        cache.storeProperties([["sysObjectId": "b1"], ["sysObjectId": "b2"]], collectionName: "items", forQuery: itemUrl("b"))
+        AXAssertNotNil(cache.propertiesForQuery(itemUrl("a")))
+        cache.storeProperties([["sysObjectId": "c1"]], collectionName: "items", forQuery: itemUrl("c"))
+        
+        AXAssertEqual(cache.objectCount, 3)
+        AXAssertNotNil(cache.propertiesForQuery(itemUrl("a")))
+        AXAssertNil(cache.propertiesForQuery(itemUrl("b")))
+        AXAssertNotNil(cache.propertiesForQuery(itemUrl("c")))
+    }
+
+}
@@ -0,0 +1,211 @@
+
+import Foundation
+import XCTest
+import Appstax
+
+@objc class ObjectFindTests: XCTestCase {
+    
+    override func setUp() {
+        super.setUp()
+        OHHTTPStubs.setEnabled(true)
+        OHHTTPStubs.removeAllStubs()
+        Appstax.setAppKey("test-api-key", baseUrl:"http://localhost:3000/");
+        Appstax.setLogLevel("debug");
+    }
+    
+    override func tearDown() {
+        super.tearDown()
+        OHHTTPStubs.setEnabled(false)
+    }
+    
+    func stubItems(count: Int) {
+        let items = (0..<count).map({ ["sysObjectId": "id\($0)", "name": "item\($0)"] })
+        AXStubs.method("GET", urlPath: "/objects/items") { request in
+            return OHHTTPStubsResponse(JSONObject: ["objects": items], statusCode: 200, headers: [:])
+        }
+    }
+    
+    func stubPagedItems(count: Int, requestedPages: (Int) -> ()) {
+        AXStubs.method("GET", urlPath: "/objects/items") { request in
+            let query = request.URL?.query ?? ""
+            let parameters = query.componentsSeparatedByString("&").map({ $0.componentsSeparatedByString("=") })
+            let value: (String) -> Int = { name in Int(parameters.filter({ $0.first == name }).first?.last ?? "") ?? 0 }
+            let page = value("pagenum")
+            let pageSize = value("pagelimit")
+            requestedPages(page)
+            let items = (page * pageSize..<min((page + 1) * pageSize, count)).map({ ["sysObjectId": "id\($0)", "name": "item\($0)"] })
+            return OHHTTPStubsResponse(JSONObject: ["objects": items], statusCode: 200, headers: [:])
+        }
+    }
+    
+    func testCursorShouldWalkThroughAllPages() {
+        let async = expectationWithDescription("async")
+        var pages: [Int] = []
+        stubPagedItems(7) { pages.append($0) }
+        
+        var pageSizes: [Int] = []
+        var names: [String] = []
+        let cursor = AXObject.cursor("items", pageSize: 3)
+        cursor.forEachPage({
+            objects, next in
+            pageSizes.append(objects.count)
+            names += objects.map({ $0["name"] as? String ?? "" })
+            next()
+        }, completion: {
+            error in
+            AXAssertNil(error)
+            async.fulfill()
+        })
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(pages, [0, 1, 2])
+            AXAssertEqual(pageSizes, [3, 3, 1])
+            AXAssertEqual(names, (0..<7).map({ "item\($0)" }))
+            XCTAssertTrue(cursor.isFinished)
+        }
+    }
+    
+    func testCursorShouldStopLoadingPagesWhenCancelled() {
+        let async = expectationWithDescription("async")
+        var pages: [Int] = []
+        stubPagedItems(100) { pages.append($0) }
+        
+        var pageCount = 0
+        let cursor = AXObject.cursor("items", pageSize: 10)
+        cursor.maxPrefetchedPages = 1
+        cursor.forEachPage({
+            objects, next in
+            pageCount += 1
+            if pageCount == 2 {
+                cursor.cancel()
+            }
+            next()
+        }, completion: {
+            error in
+            AXAssertNil(error)
+            delay(0.3, async.fulfill)
+        })
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(pageCount, 2)
+            XCTAssertTrue(cursor.isCancelled)
+            XCTAssertLessThanOrEqual(pages.count, 3)
+        }
+    }
+    
+    func testIdenticalFindsInFlightShouldShareOneRequest() {
+        let async = expectationWithDescription("async")
+        var requestCount = 0
+        AXStubs.method("GET", urlPath: "/objects/items") { request in
+            requestCount += 1
+            return OHHTTPStubsResponse(JSONObject: ["objects": [["sysObjectId": "id1"]]], statusCode: 200, headers: [:]).responseTime(0.2)
+        }
+        
+        var results: [[AXObject]] = []
+        for _ in 1...3 {
+            AXObject.findAll("items") {
+                objects, error in
+                results.append(objects ?? [])
+                if results.count == 3 {
+                    async.fulfill()
+                }
+            }
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(requestCount, 1)
+            AXAssertEqual(Appstax.defaultContext.apiClient.coalescedRequests, 2)
+            AXAssertEqual(results.map({ $0.first?.objectID ?? "" }), ["id1", "id1", "id1"])
+            XCTAssertFalse(results[0][0] === results[1][0])
+        }
+    }
+    
+    func testFindWithIdShouldCombineLookupsWithinBatchWindow() {
+        let async = expectationWithDescription("async")
+        var filters: [String] = []
+        AXStubs.method("GET", urlPath: "/objects/items") { request in
+            filters.append(request.URL?.query ?? "")
+            return OHHTTPStubsResponse(JSONObject: ["objects": [
+                ["sysObjectId": "id1", "name": "item1"],
+                ["sysObjectId": "id2", "name": "item2"]
+            ]], statusCode: 200, headers: [:])
+        }
+        
+        Appstax.defaultContext.objectService.findByIdBatchWindow = 0.05
+        var names: [String:String] = [:]
+        var missingError: NSError?
+        var completed = 0
+        for id in ["id1", "id2", "id1", "id3"] {
+            AXObject.find("items", withId: id) {
+                object, error in
+                if let object = object {
+                    names[id] = object["name"] as? String
+                } else {
+                    missingError = error
+                }
+                completed += 1
+                if completed == 4 {
+                    async.fulfill()
+                }
+            }
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(filters.count, 1)
+            AXAssertStringContains(filters.first, needle: "filter=sysObjectId%3D%27id1%27%20or%20sysObjectId%3D%27id2%27%20or%20sysObjectId%3D%27id3%27")
+            AXAssertEqual(names["id1"], "item1")
+            AXAssertEqual(names["id2"], "item2")
+            AXAssertEqual(missingError?.code, 404)
+        }
+    }
+    
+    func testFindAllShouldDeliverObjectsInBatches() {
+        let async = expectationWithDescription("async")
+        stubItems(7)
+        
+        var batchSizes: [Int] = []
+        var names: [String] = []
+        Appstax.defaultContext.objectService.findAll("items", options: nil, batchSize: 3, batch: {
+            objects in
+            XCTAssertTrue(NSThread.isMainThread())
+            batchSizes.append(objects.count)
+            names += objects.map({ $0["name"] as? String ?? "" })
+        }, completion: {
+            error in
+            AXAssertNil(error)
+            async.fulfill()
+        })
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(batchSizes, [3, 3, 1])
+            AXAssertEqual(names, (0..<7).map({ "item\($0)" }))
+        }
+    }
+    
+    func testFindAllShouldCallCompletionOnCompletionQueue() {
+        let async = expectationWithDescription("async")
+        stubItems(2)
+        
+        let queue = dispatch_queue_create("test.completion", DISPATCH_QUEUE_SERIAL)
+        let queueKey = UnsafeMutablePointer<Void>.alloc(1)
+        dispatch_queue_set_specific(queue, queueKey, queueKey, nil)
+        
+        let objectService = Appstax.defaultContext.objectService
+        objectService.completionQueue = queue
+        var objectCount = 0
+        var onQueue = false
+        objectService.findAll("items", options: nil) {
+            objects, error in
+            objectCount = objects?.count ?? 0
+            onQueue = dispatch_get_specific(queueKey) == queueKey
+            async.fulfill()
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(objectCount, 2)
+            XCTAssertTrue(onQueue)
+            queueKey.dealloc(1)
+        }
+    }
+
+}
@@ -620,6 +620,57 @@ import Appstax
         }
     }
     
+    func testSaveAllShouldSaveEachObjectAsSoonAsItsRelatedObjectsHaveIds() {
+        let async = expectationWithDescription("async")
+        
+        var requests: [String] = []
+        var httpBody: [String:[String:AnyObject]] = [:]
+        AXStubs.method("POST", urlPath: "/objects/products") { request in
+            let body = self.dictionaryFromRequestBody(request)
+            let name = body?["name"] as? String ?? ""
+            requests.append(name)
+            let response = OHHTTPStubsResponse(JSONObject: ["sysObjectId":"\(name)-id"], statusCode: 200, headers: [:])
+            return name == "product2" ? response.responseTime(0.5) : response
+        }
+        AXStubs.method("POST", urlPath: "/objects/items") { request in
+            let body = self.dictionaryFromRequestBody(request)
+            let name = body?["name"] as? String ?? ""
+            requests.append(name)
+            httpBody[name] = body
+            return OHHTTPStubsResponse(JSONObject: ["sysObjectId":"\(name)-id"], statusCode: 200, headers: [:])
+        }
+        AXStubs.method("POST", urlPath: "/objects/orders") { request in
+            requests.append("order")
+            httpBody["order"] = self.dictionaryFromRequestBody(request)
+            return OHHTTPStubsResponse(JSONObject: ["sysObjectId":"order-id"], statusCode: 200, headers: [:])
+        }
+        
+        let order = AXObject.create("orders")
+        let item1 = AXObject.create("items", properties: ["name": "item1"])
+        let item2 = AXObject.create("items", properties: ["name": "item2"])
+        item1["product"] = AXObject.create("products", properties: ["name": "product1"])
+        item2["product"] = AXObject.create("products", properties: ["name": "product2"])
+        order["items"] = [item1, item2]
+        
+        order.saveAll() { error in
+            AXAssertNil(error)
+            async.fulfill()
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(requests.count, 5)
+            XCTAssertLessThan(requests.indexOf("product1") ?? 99, requests.indexOf("item1") ?? -1)
+            XCTAssertLessThan(requests.indexOf("item1") ?? 99, requests.indexOf("item2") ?? -1)
+            XCTAssertLessThan(requests.indexOf("product2") ?? 99, requests.indexOf("item2") ?? -1)
+            AXAssertEqual(requests.last, "order")
+            
+            AXAssertContains(self.relationChangesFromBody(httpBody["item1"], property: "product")?["additions"], needle: "product1-id")
+            AXAssertContains(self.relationChangesFromBody(httpBody["item2"], property: "product")?["additions"], needle: "product2-id")
+            let orderChanges = self.relationChangesFromBody(httpBody["order"], property: "items")
+            AXAssertEqual(orderChanges?["additions"]?.count, 2)
+        }
+    }
+    
     func testSaveAllShouldAlsoSaveObjectsWithoutRelationChanges() {
         let async = expectationWithDescription("async")
         
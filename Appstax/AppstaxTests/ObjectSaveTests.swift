@@ -0,0 +1,188 @@
+
+import Foundation
+import XCTest
+import Appstax
+
+@objc class ObjectSaveTests: XCTestCase {
+    
+    override func setUp() {
+        super.setUp()
+        OHHTTPStubs.setEnabled(true)
+        OHHTTPStubs.removeAllStubs()
+        Appstax.setAppKey("test-api-key", baseUrl:"http://localhost:3000/");
+        Appstax.setLogLevel("debug");
+    }
+    
+    override func tearDown() {
+        super.tearDown()
+        OHHTTPStubs.setEnabled(false)
+    }
+    
+    func dictionaryFromRequestBody(request: NSURLRequest) -> [String:AnyObject]? {
+        let httpBody = NSURLProtocol.propertyForKey("HTTPBody", inRequest: request) as? NSData
+        return (try? NSJSONSerialization.JSONObjectWithData(httpBody!, options: NSJSONReadingOptions(rawValue: 0))) as? [String:AnyObject]
+    }
+    
+    func testShouldSaveObjectsInBulkRequestsPerCollection() {
+        let async = expectationWithDescription("async")
+        
+        var itemsBodies: [[[String:AnyObject]]] = []
+        var othersBodies: [[[String:AnyObject]]] = []
+        var idCounter = 0
+        let respond: ([[String:AnyObject]]) -> OHHTTPStubsResponse = {
+            objects in
+            let results: [[String:AnyObject]] = objects.map {
+                if let id = $0["sysObjectId"] as? String {
+                    return ["sysObjectId": id]
+                }
+                idCounter += 1
+                return ["sysObjectId": "new-id-\(idCounter)"]
+            }
+            return OHHTTPStubsResponse(JSONObject: ["objects": results], statusCode: 200, headers: [:])
+        }
+        AXStubs.method("POST", urlPath: "/objects/items/bulk") { request in
+            let objects = self.dictionaryFromRequestBody(request)?["objects"] as? [[String:AnyObject]] ?? []
+            itemsBodies.append(objects)
+            return respond(objects)
+        }
+        AXStubs.method("POST", urlPath: "/objects/others/bulk") { request in
+            let objects = self.dictionaryFromRequestBody(request)?["objects"] as? [[String:AnyObject]] ?? []
+            othersBodies.append(objects)
+            return respond(objects)
+        }
+        
+        let items = [
+            AXObject.create("items", properties: ["name": "item1"]),
+            AXObject.create("items", properties: ["name": "item2"]),
+            AXObject.create("items", properties: ["name": "item3"]),
+            AXObject.create("items", properties: ["name": "item4", "sysObjectId": "existing-id"])
+        ]
+        let others = [
+            AXObject.create("others", properties: ["name": "other1"]),
+            AXObject.create("others", properties: ["name": "other2"])
+        ]
+        let changedItem = items[3]
+        changedItem["name"] = "item4 changed"
+        
+        let objectService = Appstax.defaultContext.objectService
+        objectService.saveBatchSize = 2
+        var saveFailures: [AXObject:NSError]?
+        objectService.saveObjects(items + others, failures: {
+            saveFailures = $0
+            async.fulfill()
+        })
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(saveFailures?.count, 0)
+            AXAssertEqual(itemsBodies.count, 2)
+            AXAssertEqual(othersBodies.count, 1)
+            AXAssertEqual(othersBodies.first?.count, 2)
+            let sentItemNames = itemsBodies.flatten().map({ $0["name"] as? String ?? "" })
+            AXAssertEqual(sentItemNames.count, 4)
+            AXAssertContains(sentItemNames, needle: "item4 changed")
+            for object in items + others {
+                AXAssertNotNil(object.objectID)
+                AXAssertEqual(object.status.rawValue, AXObjectStatus.Saved.rawValue)
+            }
+            AXAssertEqual(items[3].objectID, "existing-id")
+            AXAssertEqual(Set((items + others).flatMap({ $0.objectID })).count, 6)
+        }
+    }
+    
+    func testShouldReportPerObjectFailuresFromBulkSave() {
+        let async = expectationWithDescription("async")
+        
+        AXStubs.method("POST", urlPath: "/objects/items/bulk") { request in
+            return OHHTTPStubsResponse(JSONObject: ["objects": [
+                ["sysObjectId": "id1"],
+                ["errorMessage": "Bad item"],
+                ["sysObjectId": "id3"]
+            ]], statusCode: 200, headers: [:])
+        }
+        
+        let object1 = AXObject.create("items", properties: ["name": "item1"])
+        let object2 = AXObject.create("items", properties: ["name": "item2"])
+        let object3 = AXObject.create("items", properties: ["name": "item3"])
+        
+        let objectService = Appstax.defaultContext.objectService
+        objectService.saveBatchSize = 10
+        var saveFailures: [AXObject:NSError]?
+        objectService.saveObjects([object1, object2, object3], failures: {
+            saveFailures = $0
+            async.fulfill()
+        })
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(saveFailures?.count, 1)
+            AXAssertEqual(saveFailures?[object2]?.userInfo["errorMessage"], "Bad item")
+            AXAssertEqual(object1.objectID, "id1")
+            AXAssertNil(object2.objectID)
+            AXAssertEqual(object3.objectID, "id3")
+            AXAssertEqual(object1.status.rawValue, AXObjectStatus.Saved.rawValue)
+            AXAssertEqual(object2.status.rawValue, AXObjectStatus.Modified.rawValue)
+            AXAssertEqual(object3.status.rawValue, AXObjectStatus.Saved.rawValue)
+        }
+    }
+    
+    func testShouldReportNewObjectsWithoutIdInBulkSaveResultAsFailures() {
+        let async = expectationWithDescription("async")
+        
+        AXStubs.method("POST", urlPath: "/objects/items/bulk") { request in
+            return OHHTTPStubsResponse(JSONObject: ["objects": [
+                ["sysObjectId": "id1"],
+                [:]
+            ]], statusCode: 200, headers: [:])
+        }
+        
+        let object1 = AXObject.create("items", properties: ["name": "item1"])
+        let object2 = AXObject.create("items", properties: ["name": "item2"])
+        
+        let objectService = Appstax.defaultContext.objectService
+        objectService.saveBatchSize = 10
+        var saveFailures: [AXObject:NSError]?
+        objectService.saveObjects([object1, object2], failures: {
+            saveFailures = $0
+            async.fulfill()
+        })
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(saveFailures?.count, 1)
+            AXAssertNotNil(saveFailures?[object2])
+            AXAssertEqual(object1.objectID, "id1")
+            AXAssertNil(object2.objectID)
+            AXAssertEqual(object1.status.rawValue, AXObjectStatus.Saved.rawValue)
+            AXAssertEqual(object2.status.rawValue, AXObjectStatus.Modified.rawValue)
+        }
+    }
+    
+    func testShouldLimitConcurrentSaveRequests() {
+        let async = expectationWithDescription("async")
+        
+        var requestCount = 0
+        AXStubs.method("POST", urlPath: "/objects/items") { request in
+            requestCount += 1
+            return OHHTTPStubsResponse(JSONObject: ["sysObjectId": NSUUID().UUIDString], statusCode: 200, headers: [:]).responseTime(0.2)
+        }
+        
+        let objects = (1...8).map({ AXObject.create("items", properties: ["name": "item\($0)"]) })
+        let objectService = Appstax.defaultContext.objectService
+        objectService.maxConcurrentSaveRequests = 2
+        let startTime = NSDate()
+        var elapsed: NSTimeInterval = 0
+        objectService.saveObjects(objects, failures: {
+            _ in
+            elapsed = NSDate().timeIntervalSinceDate(startTime)
+            async.fulfill()
+        })
+        
+        waitForExpectationsWithTimeout(5) { error in
+            AXAssertEqual(requestCount, 8)
+            // 8 requests of 0.2s each, at most 2 at a time
+            XCTAssertGreaterThanOrEqual(elapsed, 0.75)
+            for object in objects {
+                AXAssertEqual(object.status.rawValue, AXObjectStatus.Saved.rawValue)
+            }
+        }
+    }
+
+}
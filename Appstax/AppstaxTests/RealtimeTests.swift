@@ -1,5 +1,6 @@
 
 import Foundation
+import UIKit
 import XCTest
 @testable import Appstax
 
@@ -9,6 +10,8 @@ import XCTest
     private var appKeyHeader: String?
     private var websocketUrl: NSURL?
     private var serverReceived: [[String:AnyObject]] = []
+    private var serverFrames = 0
+    private var sessionRequests = 0
     private var sessionRequestShouldFail = false
     private var websocketRequestShouldFail = false
     
@@ -23,10 +26,13 @@ import XCTest
         appKeyHeader = nil
         websocketUrl = nil
         serverReceived = []
+        serverFrames = 0
+        sessionRequests = 0
         sessionRequestShouldFail = false
         websocketRequestShouldFail = false
         AXStubs.method("POST", urlPath: "/messaging/realtime/sessions") { request in
             self.appKeyHeader = request.allHTTPHeaderFields?["x-appstax-appkey"]
+            self.sessionRequests += 1
             if self.sessionRequestShouldFail {
                 return OHHTTPStubsResponse(JSONObject: ["":""], statusCode: 422, headers: [:])
             } else {
@@ -36,7 +42,8 @@ import XCTest
         realtimeService.webSocketFactory = {
             self.websocketUrl = $0
             let webSocket = MockWebSocket(self.realtimeService, fail: self.websocketRequestShouldFail) {
-                self.serverReceived.append($0)
+                self.serverFrames += 1
+                self.serverReceived += $0
             }
             return webSocket
         }
@@ -84,10 +91,12 @@ import XCTest
         }
         waitForExpectationsWithTimeout(10) { error in
             AXAssertEqual(channelOpen, 2)
-            AXAssertEqual(self.serverReceived.count, 2)
+            AXAssertEqual(self.serverReceived.count, 3)
             AXAssertEqual(self.serverReceived[0]["command"], "subscribe")
-            AXAssertEqual(self.serverReceived[1]["command"], "publish")
-            AXAssertEqual(self.serverReceived[1]["message"], "Message!")
+            AXAssertEqual(self.serverReceived[1]["command"], "subscribe")
+            AXAssertEqual(self.serverReceived[1]["channel"], "public/chat")
+            AXAssertEqual(self.serverReceived[2]["command"], "publish")
+            AXAssertEqual(self.serverReceived[2]["message"], "Message!")
         }
     }
     
@@ -109,6 +118,35 @@ import XCTest
         }
     }
     
+    func testShouldShareSubscriptionsForChannelsWithSameNameAndFilter() {
+        let async = expectationWithDescription("async")
+        
+        var chat1: AXChannel? = AXChannel("public/chat")
+        var chat2: AXChannel? = AXChannel("public/chat")
+        var filtered: AXChannel? = AXChannel("public/chat", filter: "a = 1")
+        
+        delay(1) {
+            AXAssertEqual(self.serverReceived.count, 2)
+            chat1 = nil
+            filtered = nil
+            AXAssertEqual(self.serverReceived.count, 3)
+            chat2 = nil
+            AXAssertEqual(self.serverReceived.count, 4)
+            async.fulfill()
+        }
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertNil(chat1)
+            AXAssertNil(chat2)
+            AXAssertNil(filtered)
+            AXAssertEqual(self.serverReceived[2]["command"], "unsubscribe")
+            AXAssertEqual(self.serverReceived[2]["channel"], "public/chat")
+            AXAssertEqual(self.serverReceived[2]["filter"], "a = 1")
+            AXAssertEqual(self.serverReceived[3]["command"], "unsubscribe")
+            AXAssertEqual(self.serverReceived[3]["channel"], "public/chat")
+            AXAssertNil(self.serverReceived[3]["filter"])
+        }
+    }
+    
     func testShouldGetErrorEventWhenSessionRequestFails() {
         sessionRequestShouldFail = true
         let async = expectationWithDescription("async")
@@ -177,6 +215,50 @@ import XCTest
         }
     }
     
+    func testShouldLimitQueueAndReplaceQueuedMessagesWhileDisconnected() {
+        let async = expectationWithDescription("async")
+        Appstax.setRealtimeQueueLimit(3, overflow: .DropOldest)
+        
+        let chat = AXChannel("public/chat")
+        let stocks = AXChannel("public/stocks")
+        chat.send("1")
+        stocks.send("AAPL 1", replaceQueued: true)
+        chat.send("2")
+        for i in 2...1000 {
+            stocks.send("AAPL \(i)", replaceQueued: true)
+        }
+        chat.send("3")
+        
+        delay(1, async.fulfill)
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(Appstax.realtimeDroppedMessageCount, 1)
+            AXAssertEqual(self.serverReceived.count, 5)
+            AXAssertEqual(self.serverReceived[0]["command"], "subscribe")
+            AXAssertEqual(self.serverReceived[1]["command"], "subscribe")
+            AXAssertEqual(self.serverReceived[2]["message"], "2")
+            AXAssertEqual(self.serverReceived[3]["message"], "AAPL 1000")
+            AXAssertEqual(self.serverReceived[4]["message"], "3")
+        }
+    }
+    
+    func testShouldBatchPacketsIntoFramesWhenEnabled() {
+        let async = expectationWithDescription("async")
+        realtimeService.batchFrames = true
+        realtimeService.maxBatchSize = 2
+        
+        let chat = AXChannel("public/chat")
+        chat.send("1")
+        chat.send("2")
+        chat.send("3")
+        
+        delay(1, async.fulfill)
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(self.serverReceived.count, 4)
+            AXAssertEqual(self.serverFrames, 2)
+            AXAssertEqual(self.serverReceived[3]["message"], "3")
+        }
+    }
+    
     func testShouldMapServerEventsToChannels() {
         let async = expectationWithDescription("async")
         
@@ -315,13 +397,28 @@ import XCTest
         }
     }
     
+    func testShouldStopDeliveringEventsToReleasedChannels() {
+        var received: [String] = []
+        var wildcard: AXChannel? = AXChannel("public/a/*")
+        let exact = AXChannel("public/a/1")
+        wildcard?.on("message") { _ in received.append("wildcard") }
+        exact.on("message") { _ in received.append("exact") }
+        
+        serverSend(["channel":"public/a/1", "event":"message", "message":"A1"])
+        wildcard = nil
+        serverSend(["channel":"public/a/1", "event":"message", "message":"A1"])
+        
+        AXAssertEqual(received, ["exact", "wildcard", "exact"])
+    }
+    
     func testShouldSubscribeToAPrivateChannel() {
         let async = expectationWithDescription("async")
         
-        let _ = AXChannel("private/mychannel")
+        let channel = AXChannel("private/mychannel")
         
         delay(1, async.fulfill)
         waitForExpectationsWithTimeout(3) { error in
+            XCTAssertNotNil(channel)
             AXAssertEqual(self.serverReceived.count, 1)
             AXAssertEqual(self.serverReceived[0]["command"], "subscribe")
             AXAssertEqual(self.serverReceived[0]["channel"], "private/mychannel")
@@ -368,10 +465,11 @@ import XCTest
     func testShouldSubscribeToObjectChannel() {
         let async = expectationWithDescription("async")
         
-        let _ = AXChannel("objects/mycollection")
+        let channel = AXChannel("objects/mycollection")
         
         delay(1, async.fulfill)
         waitForExpectationsWithTimeout(8) { error in
+            XCTAssertNotNil(channel)
             AXAssertEqual(self.serverReceived.count, 1)
             AXAssertEqual(self.serverReceived[0]["channel"], "objects/mycollection")
             AXAssertEqual(self.serverReceived[0]["command"], "subscribe")
@@ -381,10 +479,11 @@ import XCTest
     func testShouldSubscribeToObjectChannelWithFilter() {
         let async = expectationWithDescription("async")
         
-        let _ = AXChannel("objects/mycollection", filter: "text like Hello%")
+        let channel = AXChannel("objects/mycollection", filter: "text like Hello%")
         
         delay(1, async.fulfill)
         waitForExpectationsWithTimeout(8) { error in
+            XCTAssertNotNil(channel)
             AXAssertEqual(self.serverReceived.count, 1)
             AXAssertEqual(self.serverReceived[0]["channel"], "objects/mycollection")
             AXAssertEqual(self.serverReceived[0]["command"], "subscribe")
@@ -434,6 +533,32 @@ import XCTest
         }
     }
     
+    func testShouldDecodeReceivedTextOffTheMainThreadAndDeliverOnMain() {
+        let async = expectationWithDescription("async")
+        
+        let channel = AXChannel("objects/mycollection4")
+        var receivedObjects: [AXObject?] = []
+        var deliveredOnMain = true
+        channel.on("object.created") {
+            receivedObjects.append($0.object)
+            deliveredOnMain = deliveredOnMain && NSThread.isMainThread()
+        }
+        
+        realtimeService.webSocketDidReceiveText("{\"channel\":\"objects/other\",\"event\":\"object.created\",\"data\":{\"sysObjectId\":\"id0\"}}")
+        realtimeService.webSocketDidReceiveText("[{\"channel\":\"objects/mycollection4\",\"event\":\"object.created\",\"data\":{\"sysObjectId\":\"id1\"}}," +
+                                                 "{\"channel\":\"objects/mycollection4\",\"event\":\"object.created\",\"data\":{\"sysObjectId\":\"id2\"}}]")
+        AXAssertEqual(receivedObjects.count, 0)
+        
+        delay(0.5, async.fulfill)
+        waitForExpectationsWithTimeout(3) { error in
+            XCTAssertTrue(deliveredOnMain)
+            AXAssertEqual(receivedObjects.count, 2)
+            AXAssertEqual(receivedObjects[0]?.objectID, "id1")
+            AXAssertEqual(receivedObjects[0]?.collectionName, "mycollection4")
+            AXAssertEqual(receivedObjects[1]?.objectID, "id2")
+        }
+    }
+    
     func testShouldTriggerStatusEventsThrougoutConnectionLifecycle() {
         let async = expectationWithDescription("async")
         
@@ -464,29 +589,89 @@ import XCTest
         }
     }
     
+    func testShouldRequestNewSessionWhenWebSocketKeepsFailingToOpen() {
+        websocketRequestShouldFail = true
+        let async = expectationWithDescription("async")
+        
+        let channel = AXChannel("public/chat")
+        var channelError = 0
+        channel.on("error") { _ in
+            channelError += 1
+        }
+        
+        delay(3, async.fulfill)
+        waitForExpectationsWithTimeout(5) { error in
+            XCTAssertGreaterThanOrEqual(channelError, 2)
+            XCTAssertGreaterThanOrEqual(self.sessionRequests, 2)
+            AXAssertEqual(self.serverReceived.count, 0)
+        }
+    }
+    
+    func testShouldReconnectWhenPingIsNotAnswered() {
+        realtimeService.heartbeatInterval = 0.3
+        let async = expectationWithDescription("async")
+        
+        let channel = AXChannel("public/chat")
+        var channelOpen = 0
+        channel.on("open") { _ in
+            channelOpen += 1
+        }
+        
+        delay(2.5, async.fulfill)
+        waitForExpectationsWithTimeout(5) { error in
+            AXAssertEqual(channelOpen, 2)
+            AXAssertEqual(self.sessionRequests, 1)
+        }
+    }
+    
+    func testShouldDisconnectInBackgroundAndReconnectInForeground() {
+        let async = expectationWithDescription("async")
+        
+        let channel = AXChannel("public/chat")
+        var channelOpen = 0
+        channel.on("open") { _ in
+            channelOpen += 1
+        }
+        
+        delay(1) {
+            NSNotificationCenter.defaultCenter().postNotificationName(UIApplicationDidEnterBackgroundNotification, object: nil)
+            AXAssertEqual(self.realtimeService.status.rawValue, AXRealtimeServiceStatus.Disconnected.rawValue)
+            NSNotificationCenter.defaultCenter().postNotificationName(UIApplicationWillEnterForegroundNotification, object: nil)
+            AXAssertEqual(self.realtimeService.status.rawValue, AXRealtimeServiceStatus.Connecting.rawValue)
+            delay(1, async.fulfill)
+        }
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(channelOpen, 2)
+            AXAssertEqual(self.realtimeService.status.rawValue, AXRealtimeServiceStatus.Connected.rawValue)
+            AXAssertEqual(self.serverReceived.count, 2)
+        }
+    }
+    
 
 }
 
 private class MockWebSocket: AXWebSocketAdapter {
     
-    private var realtimeService: AXRealtimeService!
-    private var received: ([String:AnyObject])->()
+    private weak var realtimeService: AXRealtimeService?
+    private var received: ([[String:AnyObject]])->()
 
-    init(_ realtimeService: AXRealtimeService, fail: Bool, received: ([String:AnyObject])->()) {
+    init(_ realtimeService: AXRealtimeService, fail: Bool, received: ([[String:AnyObject]])->()) {
         self.realtimeService = realtimeService
         self.received = received
         delay(0.5) {
             if fail {
-                self.realtimeService.webSocketDidDisconnect(NSError(domain: "webSocketDidDisconnect", code: 0, userInfo: nil))
+                self.realtimeService?.webSocketDidDisconnect(NSError(domain: "webSocketDidDisconnect", code: 0, userInfo: nil))
             } else {
-                self.realtimeService.webSocketDidConnect()
+                self.realtimeService?.webSocketDidConnect()
             }
         }
     }
     
     func send(message:AnyObject) {
         if let packet = message as? [String:AnyObject] {
-            received(packet)
+            received([packet])
+        } else if let packets = message as? [[String:AnyObject]] {
+            received(packets)
         }
     }
     
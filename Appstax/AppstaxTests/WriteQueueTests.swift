@@ -0,0 +1,184 @@
+
+import Foundation
+import XCTest
+@testable import Appstax
+
+@objc class WriteQueueTests: XCTestCase {
+    
+    var queuePath = ""
+    var serverUp = false
+    
+    override func setUp() {
+        super.setUp()
+        OHHTTPStubs.setEnabled(true)
+        OHHTTPStubs.removeAllStubs()
+        Appstax.setAppKey("test-api-key", baseUrl:"http://localhost:3000/");
+        Appstax.setLogLevel("debug");
+        Appstax.defaultContext.apiClient.maxRetries = 0
+        queuePath = (NSTemporaryDirectory() as NSString).stringByAppendingPathComponent("WriteQueueTests-\(NSUUID().UUIDString).json")
+        serverUp = false
+    }
+    
+    override func tearDown() {
+        super.tearDown()
+        OHHTTPStubs.setEnabled(false)
+        _ = try? NSFileManager.defaultManager().removeItemAtPath(queuePath)
+    }
+    
+    func makeQueue() -> AXWriteQueue {
+        let writeQueue = AXWriteQueue(path: queuePath, apiClient: Appstax.defaultContext.apiClient)
+        writeQueue.flushRetryInterval = 0.1
+        Appstax.defaultContext.objectService.writeQueue = writeQueue
+        return writeQueue
+    }
+    
+    func stub(method: String, urlPath: String, response: AnyObject, requests: (NSURLRequest) -> ()) {
+        AXStubs.method(method, urlPath: urlPath) { request in
+            if !self.serverUp {
+                return OHHTTPStubsResponse(error: NSError(domain: NSURLErrorDomain, code: NSURLErrorCannotConnectToHost, userInfo: nil))
+            }
+            requests(request)
+            return OHHTTPStubsResponse(JSONObject: response, statusCode: 200, headers: [:])
+        }
+    }
+    
+    func testShouldSendQueuedWritesInOrderWhenServerIsBack() {
+        let writeQueue = makeQueue()
+        var requests: [String] = []
+        var updateBody: [String:AnyObject]?
+        stub("PUT", urlPath: "/objects/items/id1", response: [:]) {
+            requests.append("PUT \($0.URL!.path!)")
+            let body = NSURLProtocol.propertyForKey("HTTPBody", inRequest: $0) as? NSData
+            updateBody = (try? NSJSONSerialization.JSONObjectWithData(body!, options: [])) as? [String:AnyObject]
+        }
+        stub("POST", urlPath: "/objects/items", response: ["sysObjectId": "id2"]) {
+            requests.append("POST \($0.URL!.path!)")
+        }
+        stub("DELETE", urlPath: "/objects/items/id3", response: [:]) {
+            requests.append("DELETE \($0.URL!.path!)")
+        }
+        
+        let existing = AXObject.create("items", properties: ["sysObjectId": "id1", "name": "a", "count": 1])
+        let created = AXObject.create("items", properties: ["name": "new"])
+        let removed = AXObject.create("items", properties: ["sysObjectId": "id3"])
+        var errors: [NSError?] = []
+        let offline = expectationWithDescription("offline")
+        existing["name"] = "b"
+        existing.save {
+            error in
+            errors.append(error)
+            existing["count"] = 2
+            existing.save { errors.append($0) }
+            created.save { errors.append($0) }
+            removed.remove {
+                error in
+                errors.append(error)
+                offline.fulfill()
+            }
+        }
+        waitForExpectationsWithTimeout(3, handler: nil)
+        
+        AXAssertEqual(errors.count, 4)
+        XCTAssertTrue(errors.filter({ $0 != nil }).isEmpty)
+        XCTAssertTrue(writeQueue.isOffline)
+        AXAssertEqual(writeQueue.pendingWriteCount, 3)
+        XCTAssertTrue(created.objectID == nil)
+        
+        serverUp = true
+        let online = expectationWithDescription("online")
+        delay(1, online.fulfill)
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(requests, ["PUT /objects/items/id1", "POST /objects/items", "DELETE /objects/items/id3"])
+            AXAssertEqual(updateBody?["name"], "b")
+            AXAssertEqual(updateBody?["count"], 2)
+            AXAssertEqual(writeQueue.pendingWriteCount, 0)
+            AXAssertEqual(created.objectID, "id2")
+            XCTAssertTrue(created.status == .Saved)
+        }
+    }
+    
+    func testShouldReloadQueuedWritesFromFile() {
+        let writeQueue = makeQueue()
+        let object = AXObject.create("items", properties: ["sysObjectId": "id1", "name": "a"])
+        let async = expectationWithDescription("async")
+        object.save { error in
+            async.fulfill()
+        }
+        waitForExpectationsWithTimeout(3, handler: nil)
+        writeQueue.waitUntilWritten()
+        
+        let loadedQueue = AXWriteQueue(path: queuePath, apiClient: Appstax.defaultContext.apiClient)
+        AXAssertEqual(loadedQueue.pendingWriteCount, 1)
+    }
+    
+    func testShouldReportConflictsAndContinue() {
+        let writeQueue = makeQueue()
+        serverUp = true
+        var conflicts: [NSError] = []
+        writeQueue.conflictHandler = { record, error in
+            conflicts.append(error)
+        }
+        AXStubs.method("PUT", urlPath: "/objects/items/id1") { request in
+            return OHHTTPStubsResponse(JSONObject: ["errorMessage": "Conflict"], statusCode: 409, headers: [:])
+        }
+        AXStubs.method("PUT", urlPath: "/objects/items/id2") { request in
+            return OHHTTPStubsResponse(JSONObject: [:], statusCode: 200, headers: [:])
+        }
+        
+        let first = AXObject.create("items", properties: ["sysObjectId": "id1"])
+        let second = AXObject.create("items", properties: ["sysObjectId": "id2"])
+        var errors: [NSError?] = []
+        let async = expectationWithDescription("async")
+        first.save { errors.append($0) }
+        second.save {
+            error in
+            errors.append(error)
+            async.fulfill()
+        }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(conflicts.map({ $0.code }), [409])
+            AXAssertEqual(errors.count, 2)
+            AXAssertEqual(errors[0]?.code, 409)
+            AXAssertNil(errors[1])
+            AXAssertEqual(writeQueue.pendingWriteCount, 0)
+        }
+    }
+    
+    func testShouldReportInternalServerErrorsAsConflicts() {
+        let writeQueue = makeQueue()
+        var conflicts: [NSError] = []
+        writeQueue.conflictHandler = { record, error in
+            conflicts.append(error)
+        }
+        AXStubs.method("PUT", urlPath: "/objects/items/id1") { request in
+            return OHHTTPStubsResponse(JSONObject: ["errorMessage": "Internal error"], statusCode: 500, headers: [:])
+        }
+        
+        let object = AXObject.create("items", properties: ["sysObjectId": "id1"])
+        let async = expectationWithDescription("async")
+        object.save { _ in async.fulfill() }
+        
+        waitForExpectationsWithTimeout(3) { error in
+            AXAssertEqual(conflicts.map({ $0.code }), [500])
+            XCTAssertFalse(writeQueue.isOffline)
+            AXAssertEqual(writeQueue.pendingWriteCount, 0)
+        }
+    }
+    
+    func testShouldDropQueuedWritesWhenUserLogsOut() {
+        let writeQueue = makeQueue()
+        stub("PUT", urlPath: "/objects/items/id1", response: [:]) { _ in }
+        
+        let object = AXObject.create("items", properties: ["sysObjectId": "id1", "name": "a"])
+        let async = expectationWithDescription("async")
+        object.save { _ in async.fulfill() }
+        waitForExpectationsWithTimeout(3, handler: nil)
+        AXAssertEqual(writeQueue.pendingWriteCount, 1)
+        
+        AXUser.logout()
+        
+        AXAssertEqual(writeQueue.pendingWriteCount, 0)
+    }
+
+}